@@ -1,5 +1,5 @@
 TEMPLATE = app
-QT = core widgets widgets-private
+QT = core widgets widgets-private zlib-private
 CONFIG += c++17
 CONFIG += release optimze_full
 CONFIG -= optimize_size
@@ -13,17 +13,17 @@ OBJECTS_DIR = .build
 RCC_DIR = .build
 MOC_DIR = .build
 
-HEADERS += src/mainwindow.h   src/editorview.h   src/glfunctions.h   src/glviewport.h
-SOURCES += src/mainwindow.cpp src/editorview.cpp src/glfunctions.cpp src/glviewport.cpp
+HEADERS += src/mainwindow.h   src/editorview.h   src/glfunctions.h   src/glviewport.h   src/ringoverlay.h
+SOURCES += src/mainwindow.cpp src/editorview.cpp src/glfunctions.cpp src/glviewport.cpp src/ringoverlay.cpp
 
-HEADERS += src/glbuffer.h   src/boundprogram.h   src/dreamproject.h    src/tool.h
-SOURCES += src/glbuffer.cpp src/boundprogram.cpp src/dreamproject.cpp  src/tool.cpp
+HEADERS += src/glbuffer.h src/glbufferpool.h   src/boundprogram.h   src/dreamproject.h    src/tool.h   src/vertexarray.h
+SOURCES += src/glbuffer.cpp src/glbufferpool.cpp src/boundprogram.cpp src/dreamproject.cpp  src/tool.cpp  src/vertexarray.cpp
 
-HEADERS += src/gripitem.h   src/meshitem.h   src/edgeitem.h   src/markeritem.h
-SOURCES += src/gripitem.cpp src/meshitem.cpp src/edgeitem.cpp src/markeritem.cpp
+HEADERS += src/gripitem.h   src/meshitem.h   src/edgeitem.h   src/markeritem.h   src/meshlayeritem.h   src/griplayeritem.h   src/edgelayeritem.h
+SOURCES += src/gripitem.cpp src/meshitem.cpp src/edgeitem.cpp src/markeritem.cpp src/meshlayeritem.cpp src/griplayeritem.cpp src/edgelayeritem.cpp
 
-HEADERS += src/mathutil.h   src/dlapplication.h   src/polylineitem.h
-SOURCES += src/mathutil.cpp src/dlapplication.cpp src/polylineitem.cpp
+HEADERS += src/mathutil.h   src/dlapplication.h   src/polylineitem.h   src/gradientcache.h   src/gpuprofiler.h   src/cpurenderer.h   src/imagestreamwriter.h   src/batchexporter.h
+SOURCES += src/mathutil.cpp src/dlapplication.cpp src/polylineitem.cpp src/gradientcache.cpp src/gpuprofiler.cpp src/cpurenderer.cpp src/imagestreamwriter.cpp src/batchexporter.cpp
 
 HEADERS += src/tools/movevertex.h   src/tools/moveedge.h   src/tools/color.h   src/tools/split.h
 SOURCES += src/tools/movevertex.cpp src/tools/moveedge.cpp src/tools/color.cpp src/tools/split.cpp
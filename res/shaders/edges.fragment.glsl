@@ -0,0 +1,18 @@
+#version 330 core
+
+uniform vec4 lineColor;
+in vec2 local;
+flat in vec2 halfSize;
+
+out vec4 FragColor;
+
+void main()
+{
+  // Square caps, like a cosmetic QPen
+  vec2 coverage = clamp(halfSize - abs(local) + 0.5, 0, 1);
+  float alpha = coverage.x * coverage.y * lineColor.a;
+  if (alpha <= 0) {
+    discard;
+  }
+  FragColor = vec4(lineColor.rgb * alpha, alpha);
+}
@@ -0,0 +1,41 @@
+#version 330 core
+
+// One instance per edge: the endpoints in xy and zw
+layout (location = 0) in vec4 ends;
+// 1 if the edge is highlighted
+layout (location = 1) in float hover;
+uniform vec2 translate;
+uniform vec2 scale;
+// Size of the viewport in pixels
+uniform vec2 viewportSize;
+// Half the width of a normal and a highlighted edge, in pixels
+uniform vec2 halfWidths;
+
+// Position relative to the center of the line, in pixels, measured along
+// and across it
+out vec2 local;
+flat out vec2 halfSize;
+
+vec2 toWindow(vec2 pos)
+{
+  return ((pos * scale + translate) * 0.5 + 0.5) * viewportSize;
+}
+
+void main()
+{
+  // Edges are cosmetic lines, so they're expanded to quads in window space.
+  vec2 p1 = toWindow(ends.xy);
+  vec2 p2 = toWindow(ends.zw);
+  float len = length(p2 - p1);
+  vec2 along = len > 0.0001 ? (p2 - p1) / len : vec2(1, 0);
+  vec2 across = vec2(-along.y, along.x);
+
+  float halfWidth = hover > 0 ? halfWidths.y : halfWidths.x;
+  halfSize = vec2(len * 0.5 + halfWidth, halfWidth);
+  // Leave a pixel around the line for antialiasing.
+  vec2 corner = vec2((gl_VertexID & 1) != 0 ? 1 : -1, (gl_VertexID & 2) != 0 ? 1 : -1);
+  local = corner * (halfSize + 1.0);
+
+  vec2 window = (p1 + p2) * 0.5 + along * local.x + across * local.y;
+  gl_Position = vec4((window / viewportSize) * 2.0 - 1.0, 0.0f, 1.0f);
+}
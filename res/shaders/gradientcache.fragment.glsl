@@ -0,0 +1,14 @@
+#version 330 core
+
+uniform sampler2D atlas;
+// Offset from the current window coordinates to the ones the atlas was built with
+uniform vec2 pan;
+flat in vec2 atlasOffset;
+
+out vec4 FragColor;
+
+void main()
+{
+  // The atlas is aligned to the window's pixel grid, so no filtering is needed.
+  FragColor = texelFetch(atlas, ivec2(gl_FragCoord.xy + pan + atlasOffset), 0);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+
+// x = index of the polygon, y = index of the vertex within the polygon
+layout (location = 4) in vec2 polygon;
+uniform samplerBuffer verts;
+// x = offset of the polygon in verts, y = vertex count, z = winding direction
+uniform samplerBuffer polygons;
+// xy = offset from window coordinates to atlas coordinates, z = 1 if the polygon is cached
+uniform samplerBuffer cacheRecords;
+uniform vec2 translate;
+uniform vec2 scale;
+
+flat out vec2 atlasOffset;
+
+void main()
+{
+  vec3 record = texelFetch(cacheRecords, int(polygon.x)).xyz;
+  if (record.z <= 0) {
+    // Polygons that aren't cached are drawn by the polyramp shader instead.
+    // Collapse the triangle so that it doesn't produce any fragments.
+    gl_Position = vec4(-2, -2, 0, 1);
+    return;
+  }
+  vec3 info = texelFetch(polygons, int(polygon.x)).xyz;
+  vec2 pt = texelFetch(verts, int(info.x) + int(polygon.y)).xy;
+  gl_Position = vec4(pt * scale + translate, 0.0f, 1.0f);
+  atlasOffset = record.xy;
+}
@@ -0,0 +1,43 @@
+#version 330 core
+
+// Distance from the center of a grip to its frame, in pixels
+#define FRAME_RADIUS 4.5
+#define OUTLINE_WIDTH 3.0
+
+uniform vec4 highlightColor;
+uniform vec4 selectionColor;
+in vec2 local;
+flat in vec4 fillColor;
+flat in vec2 gripFlags;
+
+out vec4 FragColor;
+
+// Coverage of a band of the given width centered on the frame
+float band(float dist, float width)
+{
+  return clamp(width * 0.5 - abs(dist - FRAME_RADIUS) + 0.5, 0, 1);
+}
+
+vec4 over(vec4 top, vec4 bottom)
+{
+  return top + bottom * (1 - top.a);
+}
+
+void main()
+{
+  bool isSmooth = gripFlags.x > 0;
+  // Smooth vertices are drawn as circles, corners as squares.
+  float dist = isSmooth ? length(local) : max(abs(local.x), abs(local.y));
+
+  // Layers are composited as premultiplied colors, from the bottom up.
+  float inside = clamp(FRAME_RADIUS - dist + 0.5, 0, 1);
+  vec4 result = vec4(fillColor.rgb * fillColor.a, fillColor.a) * inside;
+  result = over(vec4(0, 0, 0, 1) * band(dist, OUTLINE_WIDTH), result);
+  vec4 frame = gripFlags.y > 0 ? selectionColor : highlightColor;
+  result = over(vec4(frame.rgb * frame.a, frame.a) * band(dist, isSmooth ? 1.6 : 1.0), result);
+
+  if (result.a <= 0) {
+    discard;
+  }
+  FragColor = result;
+}
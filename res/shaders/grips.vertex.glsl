@@ -0,0 +1,31 @@
+#version 330 core
+
+// One instance per grip
+layout (location = 0) in vec2 pos;
+layout (location = 1) in vec4 color;
+// x = 1 if the vertex is smooth, y = 1 if it is selected
+layout (location = 2) in vec2 flags;
+uniform vec2 translate;
+uniform vec2 scale;
+// Size of the viewport in pixels
+uniform vec2 viewportSize;
+// Half the width of the quad drawn for each grip, in pixels
+uniform float radius;
+
+out vec2 local;
+flat out vec4 fillColor;
+flat out vec2 gripFlags;
+
+void main()
+{
+  // Grips ignore the view's zoom. Snap their centers to pixel centers so
+  // that square frames stay crisp.
+  vec2 ndc = pos * scale + translate;
+  vec2 window = floor((ndc * 0.5 + 0.5) * viewportSize) + 0.5;
+
+  vec2 corner = vec2((gl_VertexID & 1) != 0 ? 1 : -1, (gl_VertexID & 2) != 0 ? 1 : -1);
+  local = corner * radius;
+  gl_Position = vec4(((window + local) / viewportSize) * 2.0 - 1.0, 0.0f, 1.0f);
+  fillColor = color;
+  gripFlags = flags;
+}
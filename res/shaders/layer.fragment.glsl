@@ -0,0 +1,11 @@
+#version 330 core
+
+uniform sampler2D layer;
+in vec2 texCoord;
+
+out vec4 FragColor;
+
+void main()
+{
+  FragColor = texture(layer, texCoord);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+layout (location = 0) in vec2 pos;
+// The fraction of the layer texture that covers the viewport
+uniform vec2 texScale;
+
+out vec2 texCoord;
+
+void main()
+{
+  gl_Position = vec4(pos, 0.0f, 1.0f);
+  texCoord = (pos * 0.5 + 0.5) * texScale;
+}
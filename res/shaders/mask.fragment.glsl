@@ -0,0 +1,8 @@
+#version 330 core
+
+out vec4 FragColor;
+
+void main()
+{
+  FragColor = vec4(0, 0, 0, 0);
+}
@@ -1,113 +1,146 @@
 #version 330 core
-#define N <N>
 
-#define EPSILON 1e-37
+// How close a point has to be to an edge, relative to the edge's length,
+// to be treated as lying on it
+#define EDGE_TOLERANCE 1e-6
 
-uniform vec2[N] verts;
-uniform vec4[N] colors;
-uniform float windingDirection;
+uniform samplerBuffer verts;
+uniform samplerBuffer colors;
+// Length of the edge from each vertex to the next one
+uniform samplerBuffer edgeLengths;
+#ifdef ANALYTIC_AA
+// 1 if the edge from each vertex to the next one is on the mesh boundary
+uniform samplerBuffer boundaryEdges;
+#endif
 uniform bool useEllipse;
 in vec2 pt;
 flat in vec2[3] control;
+flat in int polyOffset;
+flat in int polyCount;
+flat in float windingDirection;
 
 out vec4 FragColor;
 
-float msAlpha = 0;
-float msWeight = 0;
+vec2 vertex(int i)
+{
+  return texelFetch(verts, polyOffset + i).xy;
+}
 
-float coord(vec2 a, vec2 b)
+// tan(angle / 2) for the angle between a and b, where ra and rb are
+// their lengths.
+float halfAngle(vec2 a, float ra, vec2 b, float rb)
 {
+#ifdef FAST_EVALUATOR
+  // Half-angle identity: tan(x / 2) = sin(x) / (1 + cos(x))
+  return ((a.x * b.y) - (a.y * b.x)) / (ra * rb + dot(a, b));
+#else
   return tan(atan((a.x * b.y) - (a.y * b.x), dot(a, b)) * 0.5);
+#endif
 }
 
 vec4 getColor(vec2 point)
 {
   vec4 result = vec4(0, 0, 0, 0);
 
-  vec2 prev = verts[N - 3];
-  vec2 curr = verts[N - 2];
-  vec2 next = verts[N - 1];
-  vec2 normPt;
+  int N = polyCount;
+  vec2 curr = vertex(0) - point;
+  float currLen = length(curr);
+  vec2 prev = vertex(N - 1) - point;
+  float prevTan = halfAngle(prev, length(prev), curr, currLen);
 
   float w;
   float t = 0;
 
   for (int i = 0; i < N; i++) {
-    normPt = normalize(curr - point);
-    w = windingDirection * (
-      coord(prev - point, normPt) +
-      coord(normPt, next - point)
-    ) / distance(curr, point);
+    int j = i + 1 < N ? i + 1 : 0;
+    vec2 next = vertex(j) - point;
+    float nextLen = length(next);
+
+    // On an edge, the coordinates degenerate to linear interpolation
+    // between its endpoints. This also covers the vertices themselves.
+    // Adjacent polygons compute the same value here, so there are no
+    // seams between them.
+    float edgeLen = texelFetch(edgeLengths, polyOffset + i).x;
+    if (currLen + nextLen - edgeLen <= edgeLen * EDGE_TOLERANCE) {
+      return mix(
+        texelFetch(colors, polyOffset + i),
+        texelFetch(colors, polyOffset + j),
+        currLen > 0 ? currLen / (currLen + nextLen) : 0
+      );
+    }
 
-    result += colors[(i + N - 2) % N] * max(w, 0);
+    float nextTan = halfAngle(curr, currLen, next, nextLen);
+    w = windingDirection * (prevTan + nextTan) / currLen;
+
+    result += texelFetch(colors, polyOffset + i) * max(w, 0);
     t += w;
 
-    prev = curr;
     curr = next;
-    next = verts[i];
+    currLen = nextLen;
+    prevTan = nextTan;
   }
 
-  // 1e-37: Numerical instability causes calculations to be
-  // off by 1 ULP, which results in gaps between polygons.
+  // Outside of the polygon (where a concave polygon's triangle fan
+  // extends past its edges), the weights don't sum to a positive value.
   if (t > 0) {
-    if (result.a / t > EPSILON) {
-      result /= t;
-      return result;
-    } else {
-      return vec4(0, 0, 0, -1);
-    }
-  } else if (t > -1) {
-    return vec4(0, 0, 0, 0);
-  } else {
-    return vec4(0, 0, 0, -1);
+    return result / t;
   }
+  return vec4(0, 0, 0, 0);
 }
 
-void multisample(vec2 pt)
+#ifdef ANALYTIC_AA
+// Fraction of the pixel around point that is inside the mesh, based on the
+// distance to the nearest boundary edge of the polygon. Fragments are only
+// generated inside the polygon, so this fades the outermost half pixel.
+float edgeCoverage(vec2 point, float pixelSize)
 {
-  vec4 sampleColor = getColor(pt);
-  if (sampleColor.a > EPSILON) {
-    FragColor.rgb += sampleColor.rgb;
-    msAlpha = max(msAlpha, sampleColor.a);
-    msWeight += 1;
+  float coverage = 1;
+
+  int N = polyCount;
+  vec2 curr = vertex(0) - point;
+  for (int i = 0; i < N; i++) {
+    vec2 next = vertex(i + 1 < N ? i + 1 : 0) - point;
+    if (texelFetch(boundaryEdges, polyOffset + i).x > 0) {
+      // Distance to the segment, not the line, so that concave polygons
+      // aren't faded along the extensions of their edges.
+      vec2 edge = next - curr;
+      float h = clamp(-dot(curr, edge) / max(dot(edge, edge), EDGE_TOLERANCE), 0, 1);
+      float dist = length(curr + edge * h);
+      coverage = min(coverage, clamp(dist / pixelSize + 0.5, 0, 1));
+    }
+    curr = next;
   }
+  return coverage;
 }
+#endif
 
 void main()
 {
-  float distAlpha = 1;
+  float coverage = 1;
+#ifdef ANALYTIC_AA
+  // Derivatives have to be taken before any fragments are discarded.
+  vec2 pixel = fwidth(pt);
+  float pixelSize = max(pixel.x, pixel.y);
+#endif
   if (useEllipse) {
-    vec2 a = control[0] - control[1];
-    vec2 b = control[0] - control[2];
-    vec2 origin = control[0] - a - b;
-    mat2 mtx = inverse(mat2(a, b));
-    vec2 tp = mtx * (pt - origin);
-    float theta = atan(tp.x, tp.y);
-    float s = 1 - sin(theta);
-    float c = 1 - cos(theta);
-    vec2 e = control[0] - a*s - b*c;
-    float d1 = distance(origin, pt);
-    float d2 = distance(origin, e);
-    if (d1 > d2) {
-      FragColor = vec4(0, 0, 0, 0);
-      return;
+    // control[0] is the center of the ellipse and control[1] and control[2]
+    // map the corner's parallelogram onto the unit circle.
+    vec2 tp = mat2(control[1], control[2]) * (pt - control[0]);
+    float f = dot(tp, tp) - 1;
+#ifdef ANALYTIC_AA
+    // The cap's triangle extends past the curve, so this fades both sides.
+    coverage = clamp(0.5 - f / fwidth(f), 0, 1);
+    if (coverage <= 0) {
+      discard;
     }
-  }
-  FragColor = getColor(pt);
-  // Work around numerical instability by doing some manual multisampling
-  if (FragColor.a < 0) {
-    FragColor = vec4(0, 0, 0, 1);
-    msWeight = 0;
-    msAlpha = 0;
-    multisample(pt + vec2(0.1, 0.1));
-    multisample(pt + vec2(-0.1, 0.1));
-    multisample(pt + vec2(0.1, -0.1));
-    multisample(pt + vec2(-0.1, -0.1));
-    if (msWeight <= 0 || FragColor.a <= 0) {
-      FragColor = vec4(0, 0, 0, 0);
-    } else {
-      FragColor.rgb /= msWeight;
-      FragColor.a = msAlpha * distAlpha;
+#else
+    if (f > 0) {
+      discard;
     }
+#endif
   }
+  FragColor = getColor(pt);
+#ifdef ANALYTIC_AA
+  FragColor.a *= min(coverage, edgeCoverage(pt, pixelSize));
+#endif
 }
@@ -1,21 +1,52 @@
 #version 330 core
-#define N <N>
 
 layout (location = 0) in vec2 pos;
 layout (location = 1) in vec2 control1;
 layout (location = 2) in vec2 control2;
 layout (location = 3) in vec2 control3;
-uniform vec2[N] verts;
+// x = index of the polygon, y = index of the vertex within the polygon,
+// or -1 if the position is given by pos instead
+layout (location = 4) in vec2 polygon;
+uniform samplerBuffer verts;
+// x = offset of the polygon in verts, y = vertex count, z = winding direction
+uniform samplerBuffer polygons;
+#ifdef GRADIENT_CACHE
+// Polygons in the gradient cache are drawn by the gradientcache shader instead.
+// z = 1 if the polygon is cached
+uniform samplerBuffer cacheRecords;
+#endif
 uniform vec2 translate;
 uniform vec2 scale;
 
 out vec2 pt;
 flat out vec2[3] control;
+flat out int polyOffset;
+flat out int polyCount;
+flat out float windingDirection;
 
 void main()
 {
-  gl_Position = vec4(pos * scale + translate, 0.0f, 1.0f);
-  pt = pos;
+#ifdef GRADIENT_CACHE
+  if (polygon.y >= 0 && texelFetch(cacheRecords, int(polygon.x)).z > 0) {
+    // Collapse the triangle so that it doesn't produce any fragments.
+    gl_Position = vec4(-2, -2, 0, 1);
+    return;
+  }
+#endif
+
+  vec3 info = texelFetch(polygons, int(polygon.x)).xyz;
+  polyOffset = int(info.x);
+  polyCount = int(info.y);
+  windingDirection = info.z;
+
+  // Smooth corners carry their own geometry. Polygons are
+  // drawn straight from the shared vertex storage.
+  if (polygon.y < 0) {
+    pt = pos;
+  } else {
+    pt = texelFetch(verts, polyOffset + int(polygon.y)).xy;
+  }
+  gl_Position = vec4(pt * scale + translate, 0.0f, 1.0f);
   control[0] = control1;
   control[1] = control2;
   control[2] = control3;
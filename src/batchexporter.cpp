@@ -0,0 +1,294 @@
+#include "batchexporter.h"
+#include "imagestreamwriter.h"
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+#include <QRegularExpression>
+#include <functional>
+
+namespace {
+
+class BatchTask : public QRunnable
+{
+public:
+  BatchTask(const std::function<void()>& task)
+  : task(task)
+  {
+    // initializers only
+  }
+
+  void run() override
+  {
+    task();
+  }
+
+private:
+  std::function<void()> task;
+};
+
+}
+
+BatchExporter::BatchExporter()
+: m_dpi(100), m_format("png"), m_backend(DreamProject::OpenGLBackend), m_pendingEncodes(0)
+{
+  // initializers only
+}
+
+BatchExporter::~BatchExporter()
+{
+  m_pool.waitForDone();
+}
+
+void BatchExporter::setDpi(int dpi)
+{
+  m_dpi = dpi;
+}
+
+void BatchExporter::setFormat(const QByteArray& format)
+{
+  m_format = format.toLower();
+}
+
+void BatchExporter::setRenderBackend(DreamProject::Backend backend)
+{
+  m_backend = backend;
+}
+
+void BatchExporter::addJob(const QString& input, const QString& output)
+{
+  Job job;
+  job.input = input;
+  job.output = output;
+  job.format = ImageStreamWriter::formatForPath(output);
+  if (job.format.isEmpty()) {
+    job.format = m_format;
+  }
+  job.loadMsecs = job.renderMsecs = job.encodeMsecs = 0;
+  job.loaded = false;
+  job.streamed = false;
+  m_jobs << job;
+}
+
+QString BatchExporter::outputPath(const QString& input, const QString& outputDir) const
+{
+  QFileInfo info(input);
+  QString name = info.completeBaseName() + "." + QString::fromLatin1(m_format);
+  return QDir(outputDir.isEmpty() ? info.path() : outputDir).filePath(name);
+}
+
+void BatchExporter::addFiles(const QString& pattern, const QString& outputDir)
+{
+  QFileInfo info(pattern);
+  if (!info.fileName().contains(QRegularExpression("[*?[]"))) {
+    addJob(pattern, outputPath(pattern, outputDir));
+    return;
+  }
+  QDir dir = info.dir();
+  for (const QString& name : dir.entryList(QStringList{ info.fileName() }, QDir::Files, QDir::Name)) {
+    QString input = dir.filePath(name);
+    addJob(input, outputPath(input, outputDir));
+  }
+}
+
+bool BatchExporter::addManifest(const QString& path, const QString& outputDir, QString* error)
+{
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    *error = f.errorString();
+    return false;
+  }
+  QDir base = QFileInfo(path).dir();
+  QTextStream in(&f);
+  int lineNumber = 0;
+  while (!in.atEnd()) {
+    QString line = in.readLine().trimmed();
+    lineNumber++;
+    if (line.isEmpty() || line.startsWith('#')) {
+      continue;
+    }
+    QStringList fields = line.contains('\t') ? line.split('\t', Qt::SkipEmptyParts) : line.split(' ', Qt::SkipEmptyParts);
+    if (fields.length() > 2) {
+      *error = QStringLiteral("line %1: expected an input and an optional output").arg(lineNumber);
+      return false;
+    }
+    QString input = base.filePath(fields[0].trimmed());
+    QString output = fields.length() > 1 ? base.filePath(fields[1].trimmed()) : outputPath(input, outputDir);
+    addJob(input, output);
+  }
+  return true;
+}
+
+int BatchExporter::jobCount() const
+{
+  return m_jobs.length();
+}
+
+void BatchExporter::load(int index)
+{
+  QElapsedTimer timer;
+  timer.start();
+  QJsonDocument doc;
+  QString error;
+  try {
+    doc = DreamProject::readDocument(m_jobs[index].input);
+  } catch (OpenException& err) {
+    error = QString::fromUtf8(err.what());
+  }
+
+  QMutexLocker lock(&m_mutex);
+  Job& job = m_jobs[index];
+  job.doc = doc;
+  job.error = error;
+  job.loadMsecs = timer.nsecsElapsed() / 1e6;
+  job.loaded = true;
+  m_changed.wakeAll();
+}
+
+void BatchExporter::render(int index, DreamProject* project, const QJsonDocument& doc)
+{
+  QElapsedTimer timer;
+  timer.start();
+  // The project and its export context carry over from the last file.
+  project->clear();
+  project->load(doc);
+  QSize size = (project->pageSize() * m_dpi).toSize();
+
+  Job job;
+  {
+    QMutexLocker lock(&m_mutex);
+    m_jobs[index].size = size;
+    job = m_jobs[index];
+  }
+
+  if (ImageStreamWriter::supportsFormat(job.format)) {
+    // Encoded while the tiles render
+    double encodeMsecs = 0;
+    bool ok = project->exportToFile(job.output, job.format, m_dpi, &encodeMsecs);
+    QMutexLocker lock(&m_mutex);
+    m_jobs[index].renderMsecs = timer.nsecsElapsed() / 1e6;
+    m_jobs[index].encodeMsecs = encodeMsecs;
+    m_jobs[index].streamed = true;
+    if (!ok) {
+      m_jobs[index].error = "unable to write image";
+    }
+    return;
+  }
+
+  QImage image = project->render(m_dpi);
+  QMutexLocker lock(&m_mutex);
+  m_jobs[index].renderMsecs = timer.nsecsElapsed() / 1e6;
+  if (image.isNull()) {
+    m_jobs[index].error = "unable to render";
+    return;
+  }
+
+  // Don't let finished images pile up faster than they can be encoded.
+  while (m_pendingEncodes >= m_pool.maxThreadCount()) {
+    m_changed.wait(&m_mutex);
+  }
+  m_pendingEncodes++;
+  m_pool.start(new BatchTask([this, index, image]{ encode(index, image); }));
+}
+
+void BatchExporter::encode(int index, const QImage& image)
+{
+  QElapsedTimer timer;
+  timer.start();
+  QString output;
+  QByteArray format;
+  {
+    QMutexLocker lock(&m_mutex);
+    output = m_jobs[index].output;
+    format = m_jobs[index].format;
+  }
+  bool ok = image.save(output, format.constData());
+
+  QMutexLocker lock(&m_mutex);
+  m_jobs[index].encodeMsecs = timer.nsecsElapsed() / 1e6;
+  if (!ok) {
+    m_jobs[index].error = "unable to write image";
+  }
+  m_pendingEncodes--;
+  m_changed.wakeAll();
+}
+
+int BatchExporter::run(std::ostream& out)
+{
+  QElapsedTimer wall;
+  wall.start();
+
+  // Read a few files ahead of the one being rendered, but not so many that
+  // the parsed documents crowd out the renders.
+  int numJobs = m_jobs.length();
+  int lookahead = 2 * m_pool.maxThreadCount();
+  int queued = 0;
+  auto queueLoads = [&](int end) {
+    for (; queued < qMin(end, numJobs); queued++) {
+      int index = queued;
+      m_pool.start(new BatchTask([this, index]{ load(index); }));
+    }
+  };
+
+  DreamProject project(QSizeF(8.5, 11));
+  project.setRenderBackend(m_backend);
+  for (int i = 0; i < numJobs; i++) {
+    queueLoads(i + 1 + lookahead);
+    QJsonDocument doc;
+    {
+      QMutexLocker lock(&m_mutex);
+      while (!m_jobs[i].loaded) {
+        m_changed.wait(&m_mutex);
+      }
+      doc = m_jobs[i].doc;
+      m_jobs[i].doc = QJsonDocument();
+      if (!m_jobs[i].error.isEmpty()) {
+        continue;
+      }
+    }
+    render(i, &project, doc);
+  }
+  m_pool.waitForDone();
+  project.clear();
+
+  report(out, wall.nsecsElapsed() / 1e6);
+  int failures = 0;
+  for (const Job& job : m_jobs) {
+    if (!job.error.isEmpty()) {
+      failures++;
+    }
+  }
+  return failures;
+}
+
+void BatchExporter::report(std::ostream& out, double wallMsecs) const
+{
+  int exported = 0;
+  double megapixels = 0;
+  for (const Job& job : m_jobs) {
+    if (!job.error.isEmpty()) {
+      out << qPrintable(job.input) << ": " << qPrintable(job.error) << std::endl;
+      continue;
+    }
+    exported++;
+    megapixels += double(job.size.width()) * job.size.height() / 1e6;
+    // Streamed files are encoded while they render, so their render time
+    // includes whatever encoding the renderer had to wait for.
+    out << qPrintable(QStringLiteral("%1 -> %2: %3x%4, load %5 ms, render %6 ms, encode %7 ms%8")
+      .arg(job.input, job.output)
+      .arg(job.size.width()).arg(job.size.height())
+      .arg(job.loadMsecs, 0, 'f', 1)
+      .arg(job.renderMsecs, 0, 'f', 1)
+      .arg(job.encodeMsecs, 0, 'f', 1)
+      .arg(job.streamed ? " during render" : "")) << std::endl;
+  }
+
+  double seconds = wallMsecs / 1000;
+  out << qPrintable(QStringLiteral("%1 of %2 files exported in %3 s (%4 files/s, %5 megapixels/s)")
+    .arg(exported).arg(m_jobs.length())
+    .arg(seconds, 0, 'f', 2)
+    .arg(seconds > 0 ? exported / seconds : 0, 0, 'f', 2)
+    .arg(seconds > 0 ? megapixels / seconds : 0, 0, 'f', 1)) << std::endl;
+}
@@ -0,0 +1,81 @@
+#ifndef DL_BATCHEXPORTER_H
+#define DL_BATCHEXPORTER_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonDocument>
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <ostream>
+#include "dreamproject.h"
+
+// BatchExporter exports many documents in one process, so that Qt, the
+// OpenGL context and the shaders are only set up once.
+//
+// Documents are read and parsed on worker threads a few files ahead of
+// rendering. Rendering happens on the calling thread, reusing one project
+// and its export context. PNG, TIFF and PPM files are streamed by
+// exportToFile(), which already encodes on a thread of its own; other
+// formats are encoded on the worker threads while the next file renders.
+class BatchExporter
+{
+public:
+  BatchExporter();
+  ~BatchExporter();
+
+  void setDpi(int dpi);
+  // The format of outputs named by addFiles(), and of outputs without a
+  // suffix
+  void setFormat(const QByteArray& format);
+  void setRenderBackend(DreamProject::Backend backend);
+
+  void addJob(const QString& input, const QString& output);
+  // Adds each file matching the path, which may contain wildcards in its
+  // last component. Outputs are written to outputDir, or next to the
+  // inputs if it's empty, with the format's suffix.
+  void addFiles(const QString& pattern, const QString& outputDir = QString());
+  // Each line of a manifest names an input and optionally an output,
+  // separated by a tab, or by spaces if neither path contains any.
+  // Relative paths are relative to the manifest. Blank lines and lines
+  // starting with # are ignored.
+  bool addManifest(const QString& path, const QString& outputDir, QString* error);
+  int jobCount() const;
+
+  // Exports every file, then writes a line for each and a summary to out.
+  // Returns the number of files that failed.
+  int run(std::ostream& out);
+
+private:
+  struct Job {
+    QString input, output;
+    QByteArray format;
+    QString error;
+    QSize size;
+    double loadMsecs, renderMsecs, encodeMsecs;
+    // Set by the loader once the document has been read
+    bool loaded;
+    // Whether the file was encoded by exportToFile() as it rendered
+    bool streamed;
+    QJsonDocument doc;
+  };
+
+  QString outputPath(const QString& input, const QString& outputDir) const;
+  void load(int index);
+  void render(int index, DreamProject* project, const QJsonDocument& doc);
+  void encode(int index, const QImage& image);
+  void report(std::ostream& out, double wallMsecs) const;
+
+  int m_dpi;
+  QByteArray m_format;
+  DreamProject::Backend m_backend;
+  QVector<Job> m_jobs;
+
+  QThreadPool m_pool;
+  QMutex m_mutex;
+  QWaitCondition m_changed;
+  int m_pendingEncodes;
+};
+
+#endif
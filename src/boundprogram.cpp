@@ -1,12 +1,14 @@
 #include "boundprogram.h"
 #include "glfunctions.h"
 #include "glbuffer.h"
+#include "vertexarray.h"
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
+#include <QOpenGLTexture>
 #include <QtDebug>
 
 BoundProgram::BoundProgram(GLFunctions* gl, QOpenGLShaderProgram* program, QOpenGLVertexArrayObject* vao)
-: gl(gl), program(program), vao(vao)
+: gl(gl), program(program), vao(vao), vertexArray(nullptr)
 {
   program->bind();
   vao->bind();
@@ -17,22 +19,46 @@ BoundProgram::~BoundProgram()
   for (GLBufferBase* buffer : boundBuffers) {
     buffer->release();
   }
-  vao->release();
+  // The VAO is shared by every program, so don't leave stale attributes enabled.
+  for (int location : enabledAttributes) {
+    program->disableAttributeArray(location);
+  }
+  for (auto iter = boundTextures.begin(); iter != boundTextures.end(); iter++) {
+    gl->glActiveTexture(GL_TEXTURE0 + iter.key());
+    gl->glBindTexture(iter.value(), 0);
+  }
+  if (!boundTextures.isEmpty()) {
+    gl->glActiveTexture(GL_TEXTURE0);
+  }
+  if (vertexArray) {
+    vertexArray->release();
+  } else {
+    vao->release();
+  }
   program->release();
 }
 
 bool BoundProgram::bindAttributeBuffer(int location, GLBufferBase& buffer, int offset, int stride)
 {
+  if (stride < 0) {
+    stride = buffer.elementSize();
+  }
+  return bindAttribute(location, buffer, buffer.m_glType, buffer.elementLength(), offset, stride);
+}
+
+bool BoundProgram::bindAttribute(int location, GLBufferBase& buffer, int type, int length, int offset, int stride)
+{
+  Q_ASSERT(!vertexArray);
   if (!buffer.bind()) {
     qDebug() << "bind failure";
     return false;
   }
   boundBuffers.append(&buffer);
   program->enableAttributeArray(location);
-  if (stride < 0) {
-    stride = buffer.elementSize();
+  if (!enabledAttributes.contains(location)) {
+    enabledAttributes.append(location);
   }
-  program->setAttributeBuffer(location, buffer.m_glType, offset, buffer.elementLength(), stride);
+  program->setAttributeBuffer(location, type, buffer.storageOffset() + offset, length, stride);
   return true;
 }
 
@@ -40,3 +66,54 @@ bool BoundProgram::bindAttributeBuffer(const char* location, GLBufferBase& buffe
 {
   return bindAttributeBuffer(program->attributeLocation(location), buffer, offset, stride);
 }
+
+void BoundProgram::disableAttributeArray(int location)
+{
+  program->disableAttributeArray(location);
+  enabledAttributes.removeAll(location);
+}
+
+bool BoundProgram::bindVertexArray(VertexArray& array)
+{
+  Q_ASSERT(enabledAttributes.isEmpty());
+  if (vertexArray) {
+    vertexArray->release();
+  } else {
+    vao->release();
+  }
+  vertexArray = &array;
+  return array.bind(gl);
+}
+
+bool BoundProgram::bindTextureBuffer(const char* location, int unit, GLBufferBase& buffer)
+{
+  if (!buffer.m_textureFormat) {
+    qDebug() << "buffer type cannot be used as a texture";
+    return false;
+  }
+  // Without glTexBufferRange, the buffer has to start at offset 0 of its
+  // own storage. Binding the buffer uploads any pending changes.
+  buffer.setPooled(false);
+  if (!buffer.bind()) {
+    qDebug() << "bind failure";
+    return false;
+  }
+  buffer.release();
+
+  gl->glActiveTexture(GL_TEXTURE0 + unit);
+  buffer.texture()->bind();
+  gl->glTexBuffer(GL_TEXTURE_BUFFER, buffer.m_textureFormat, buffer.bufferId());
+  gl->glActiveTexture(GL_TEXTURE0);
+  boundTextures[unit] = GL_TEXTURE_BUFFER;
+  program->setUniformValue(location, unit);
+  return true;
+}
+
+void BoundProgram::bindTexture(const char* location, int unit, GLuint texture)
+{
+  gl->glActiveTexture(GL_TEXTURE0 + unit);
+  gl->glBindTexture(GL_TEXTURE_2D, texture);
+  gl->glActiveTexture(GL_TEXTURE0);
+  boundTextures[unit] = GL_TEXTURE_2D;
+  program->setUniformValue(location, unit);
+}
@@ -2,11 +2,13 @@
 #define DL_BOUNDPROGRAM_H
 
 #include <QList>
+#include <QMap>
 #include <QOpenGLShaderProgram>
 #include "glbuffer.h"
 class QOpenGLVertexArrayObject;
 class QOpenGLBuffer;
 class GLFunctions;
+class VertexArray;
 
 class BoundProgram
 {
@@ -19,6 +21,25 @@ public:
 
   bool bindAttributeBuffer(int location, GLBufferBase& buffer, int offset = 0, int stride = -1);
   bool bindAttributeBuffer(const char* location, GLBufferBase& buffer, int offset = 0, int stride = -1);
+  // Feeds every attribute of an interleaved vertex format from one buffer.
+  template <typename T>
+  bool bindVertexBuffer(GLBuffer<T>& buffer)
+  {
+    for (const GLBufferContainer::Attribute& attr : GLBufferContainer::Format<T>::attributes) {
+      if (!bindAttribute(attr.location, buffer, attr.type, attr.length, attr.offset, buffer.elementSize())) {
+        return false;
+      }
+    }
+    return true;
+  }
+  void disableAttributeArray(int location);
+
+  // Draws from a VertexArray's recorded attributes instead of the shared
+  // VAO. Don't combine this with bindAttributeBuffer().
+  bool bindVertexArray(VertexArray& array);
+
+  bool bindTextureBuffer(const char* location, int unit, GLBufferBase& buffer);
+  void bindTexture(const char* location, int unit, GLuint texture);
 
   template <typename T>
   void setUniformValueArray(const char* location, GLBuffer<T>& buffer) {
@@ -32,8 +53,12 @@ public:
 private:
   friend class GLFunctions;
   BoundProgram(GLFunctions* gl, QOpenGLShaderProgram* program, QOpenGLVertexArrayObject* vao);
+  bool bindAttribute(int location, GLBufferBase& buffer, int type, int length, int offset, int stride);
 
+  VertexArray* vertexArray;
   QList<GLBufferBase*> boundBuffers;
+  QList<int> enabledAttributes;
+  QMap<int, GLenum> boundTextures;
 };
 
 #endif
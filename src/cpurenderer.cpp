@@ -0,0 +1,629 @@
+#include "cpurenderer.h"
+#include "meshitem.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QScopedPointer>
+#include <QtDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// How close a point has to be to an edge, relative to the edge's length,
+// to be treated as lying on it. This matches polyramp.fragment.glsl.
+#define EDGE_TOLERANCE 1e-6f
+
+// The kernels use GCC vector extensions, so each eight-wide operation
+// compiles to a pair of SSE2 instructions. Where the loader can pick between
+// versions at startup, the tile shader is also built for AVX2, which does
+// it in one.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define DL_SIMD_TARGETS __attribute__((target_clones("avx2", "default")))
+#else
+#define DL_SIMD_TARGETS
+#endif
+// Everything the tile shader calls has to be inlined into it to be built
+// for the same target.
+#define DL_INLINE inline __attribute__((always_inline))
+#if defined(__GNUC__) && !defined(__clang__)
+// The vectors never cross a call into code built for another target.
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace {
+
+const int LANES = 8;
+const int TILE_SIZE = CPURenderer::TILE_SIZE;
+const int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+typedef float Floats __attribute__((vector_size(LANES * sizeof(float))));
+typedef int Mask __attribute__((vector_size(LANES * sizeof(int))));
+
+DL_INLINE Floats splat(float x)
+{
+  Floats v = {};
+  return v + x;
+}
+
+DL_INLINE Mask splatMask(bool on)
+{
+  Mask v = {};
+  return v + (on ? -1 : 0);
+}
+
+DL_INLINE Floats select(Mask m, Floats a, Floats b)
+{
+  return (Floats)((m & (Mask)a) | (~m & (Mask)b));
+}
+
+DL_INLINE Floats vmin(Floats a, Floats b)
+{
+  return select(a < b, a, b);
+}
+
+DL_INLINE Floats vmax(Floats a, Floats b)
+{
+  return select(a > b, a, b);
+}
+
+DL_INLINE Floats vabs(Floats a)
+{
+  return select(a < splat(0), -a, a);
+}
+
+DL_INLINE Floats clamp01(Floats a)
+{
+  return vmin(vmax(a, splat(0)), splat(1));
+}
+
+DL_INLINE Floats vsqrt(Floats a)
+{
+  Floats r;
+  for (int k = 0; k < LANES; k++) {
+    r[k] = std::sqrt(a[k]);
+  }
+  return r;
+}
+
+DL_INLINE bool any(Mask m)
+{
+  for (int k = 0; k < LANES; k++) {
+    if (m[k]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+DL_INLINE Floats load(const float* p)
+{
+  Floats v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+DL_INLINE void store(float* p, Floats v)
+{
+  std::memcpy(p, &v, sizeof(v));
+}
+
+DL_INLINE Mask loadMask(const int* p)
+{
+  Mask v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+DL_INLINE void storeMask(int* p, Mask v)
+{
+  std::memcpy(p, &v, sizeof(v));
+}
+
+struct PolygonData
+{
+  int offset;
+  int count;
+  float winding;
+};
+
+struct Triangle
+{
+  int polygon;
+  // Edge functions a * x + b * y + c, which are positive inside. Pixel
+  // centers on an edge are inside if the edge is a top or left edge, so
+  // that triangles sharing the edge don't both cover them.
+  double a[3], b[3], c[3];
+  bool topLeft[3];
+  // The pixels whose centers may be inside
+  QRect bounds;
+  // For caps, the corner's ellipse, as in BoundaryVertex
+  float origin[2], inverseX[2], inverseY[2];
+};
+
+bool setupTriangle(Triangle* tri, const QPointF* p)
+{
+  double area = (p[1].x() - p[0].x()) * (p[2].y() - p[0].y()) - (p[1].y() - p[0].y()) * (p[2].x() - p[0].x());
+  if (area == 0) {
+    return false;
+  }
+  int order[3] = { 0, 1, 2 };
+  if (area < 0) {
+    std::swap(order[1], order[2]);
+  }
+  for (int k = 0; k < 3; k++) {
+    const QPointF& from = p[order[k]];
+    const QPointF& to = p[order[(k + 1) % 3]];
+    double dx = to.x() - from.x();
+    double dy = to.y() - from.y();
+    tri->a[k] = -dy;
+    tri->b[k] = dx;
+    tri->c[k] = dy * from.x() - dx * from.y();
+    tri->topLeft[k] = dy > 0 || (dy == 0 && dx < 0);
+  }
+
+  double minX = std::min({ p[0].x(), p[1].x(), p[2].x() });
+  double maxX = std::max({ p[0].x(), p[1].x(), p[2].x() });
+  double minY = std::min({ p[0].y(), p[1].y(), p[2].y() });
+  double maxY = std::max({ p[0].y(), p[1].y(), p[2].y() });
+  tri->bounds.setCoords(std::ceil(minX - 0.5), std::ceil(minY - 0.5), std::floor(maxX - 0.5), std::floor(maxY - 0.5));
+  return !tri->bounds.isEmpty();
+}
+
+void binTriangle(const Triangle& tri, int index, const QRect& image, int tileColumns, QVector<QVector<int>>* bins)
+{
+  QRect bounds = tri.bounds & image;
+  if (bounds.isEmpty()) {
+    return;
+  }
+  for (int ty = bounds.top() / TILE_SIZE; ty <= bounds.bottom() / TILE_SIZE; ty++) {
+    for (int tx = bounds.left() / TILE_SIZE; tx <= bounds.right() / TILE_SIZE; tx++) {
+      (*bins)[ty * tileColumns + tx] << index;
+    }
+  }
+}
+
+struct Tile
+{
+  int x, y, width, height;
+  // Premultiplied color, one plane per channel
+  float color[4][TILE_PIXELS];
+  // -1 where the mesh's caps mask out its fans
+  int stencil[TILE_PIXELS];
+};
+
+}
+
+struct CPURenderer::MeshData
+{
+  // Polygon vertices in image coordinates, with straight-alpha colors
+  QVector<float> x, y, r, g, b, a;
+  QVector<float> edgeLength, boundary;
+  QVector<PolygonData> polygons;
+  QVector<Triangle> fans, caps;
+  // The fans and caps that touch each tile, in drawing order
+  QVector<QVector<int>> fanBins, capBins;
+};
+
+namespace {
+
+// Mean value interpolation of the polygon's colors, as in getColor() in
+// polyramp.fragment.glsl. Both of the shader's evaluators compute the same
+// half-angle tangent; this uses the identity from the fast one.
+DL_INLINE void evaluate(const CPURenderer::MeshData& mesh, const PolygonData& poly, Floats px, Floats py, Floats color[4])
+{
+  const float* vx = mesh.x.constData() + poly.offset;
+  const float* vy = mesh.y.constData() + poly.offset;
+  const float* channels[4] = {
+    mesh.r.constData() + poly.offset, mesh.g.constData() + poly.offset,
+    mesh.b.constData() + poly.offset, mesh.a.constData() + poly.offset
+  };
+  const float* edgeLengths = mesh.edgeLength.constData() + poly.offset;
+  int n = poly.count;
+
+  Floats sum[4] = {};
+  Floats total = {};
+  Floats edgeColor[4] = {};
+  Mask done = {};
+
+  Floats currX = splat(vx[0]) - px;
+  Floats currY = splat(vy[0]) - py;
+  Floats currLen = vsqrt(currX * currX + currY * currY);
+  Floats prevX = splat(vx[n - 1]) - px;
+  Floats prevY = splat(vy[n - 1]) - py;
+  Floats prevLen = vsqrt(prevX * prevX + prevY * prevY);
+  Floats prevTan = (prevX * currY - prevY * currX) / (prevLen * currLen + prevX * currX + prevY * currY);
+  Floats winding = splat(poly.winding);
+
+  for (int i = 0; i < n; i++) {
+    int j = i + 1 < n ? i + 1 : 0;
+    Floats nextX = splat(vx[j]) - px;
+    Floats nextY = splat(vy[j]) - py;
+    Floats nextLen = vsqrt(nextX * nextX + nextY * nextY);
+
+    // Points on an edge take the linear interpolation between its endpoints
+    // instead. Their weights are still accumulated but never used.
+    float edgeLen = edgeLengths[i];
+    Mask onEdge = (currLen + nextLen - splat(edgeLen) <= splat(edgeLen * EDGE_TOLERANCE)) & ~done;
+    if (any(onEdge)) {
+      Floats s = select(currLen > splat(0), currLen / (currLen + nextLen), splat(0));
+      for (int c = 0; c < 4; c++) {
+        Floats from = splat(channels[c][i]);
+        Floats to = splat(channels[c][j]);
+        edgeColor[c] = select(onEdge, from + (to - from) * s, edgeColor[c]);
+      }
+      done |= onEdge;
+    }
+
+    Floats nextTan = (currX * nextY - currY * nextX) / (currLen * nextLen + currX * nextX + currY * nextY);
+    Floats w = winding * (prevTan + nextTan) / currLen;
+    Floats weight = vmax(w, splat(0));
+    for (int c = 0; c < 4; c++) {
+      sum[c] += splat(channels[c][i]) * weight;
+    }
+    total += w;
+
+    currX = nextX;
+    currY = nextY;
+    currLen = nextLen;
+    prevTan = nextTan;
+  }
+
+  Mask inside = total > splat(0);
+  for (int c = 0; c < 4; c++) {
+    color[c] = select(done, edgeColor[c], select(inside, sum[c] / total, splat(0)));
+  }
+}
+
+// Fraction of each pixel that is inside the mesh, as in edgeCoverage() in
+// polyramp.fragment.glsl. Coordinates are in pixels, so the pixel size is 1.
+DL_INLINE Floats edgeCoverage(const CPURenderer::MeshData& mesh, const PolygonData& poly, Floats px, Floats py)
+{
+  const float* vx = mesh.x.constData() + poly.offset;
+  const float* vy = mesh.y.constData() + poly.offset;
+  const float* boundary = mesh.boundary.constData() + poly.offset;
+  int n = poly.count;
+
+  Floats coverage = splat(1);
+  for (int i = 0; i < n; i++) {
+    if (boundary[i] <= 0) {
+      continue;
+    }
+    int j = i + 1 < n ? i + 1 : 0;
+    float edgeX = vx[j] - vx[i];
+    float edgeY = vy[j] - vy[i];
+    float edgeLen2 = std::max(edgeX * edgeX + edgeY * edgeY, EDGE_TOLERANCE);
+    Floats currX = splat(vx[i]) - px;
+    Floats currY = splat(vy[i]) - py;
+    Floats h = clamp01(-(currX * edgeX + currY * edgeY) / edgeLen2);
+    Floats dx = currX + h * edgeX;
+    Floats dy = currY + h * edgeY;
+    Floats dist = vsqrt(dx * dx + dy * dy);
+    coverage = vmin(coverage, clamp01(dist + 0.5f));
+  }
+  return coverage;
+}
+
+// Coverage of the rounded part of a corner. The shader fades by
+// f / fwidth(f); this uses the exact gradient instead of the difference
+// across the pixel quad.
+DL_INLINE Floats ellipseCoverage(const Triangle& tri, Floats px, Floats py)
+{
+  Floats dx = px - tri.origin[0];
+  Floats dy = py - tri.origin[1];
+  Floats tx = tri.inverseX[0] * dx + tri.inverseY[0] * dy;
+  Floats ty = tri.inverseX[1] * dx + tri.inverseY[1] * dy;
+  Floats f = tx * tx + ty * ty - 1.0f;
+  Floats dfdx = 2.0f * (tx * tri.inverseX[0] + ty * tri.inverseX[1]);
+  Floats dfdy = 2.0f * (tx * tri.inverseY[0] + ty * tri.inverseY[1]);
+  Floats width = vabs(dfdx) + vabs(dfdy);
+  Floats inside = select(f <= splat(0), splat(1), splat(0));
+  return select(width > splat(0), clamp01(0.5f - f / width), inside);
+}
+
+// Composites straight-alpha colors over the tile.
+DL_INLINE void blend(Tile* tile, int index, Mask inside, const Floats color[4], Floats coverage)
+{
+  Floats alpha = select(inside, color[3] * coverage, splat(0));
+  Floats keep = 1.0f - alpha;
+  for (int c = 0; c < 3; c++) {
+    float* p = tile->color[c] + index;
+    store(p, select(inside, color[c] * alpha, splat(0)) + load(p) * keep);
+  }
+  float* p = tile->color[3] + index;
+  store(p, alpha + load(p) * keep);
+}
+
+enum Pass { MaskPass, CapPass, FanPass };
+
+// Visits each group of LANES pixels in the tile with a center inside the
+// triangle. Caps write the stencil in the mask pass, then draw the rounded
+// part of the corner; fans draw wherever the stencil isn't set.
+DL_INLINE void drawTriangle(const CPURenderer::MeshData& mesh, const Triangle& tri, Pass pass, Tile* tile)
+{
+  QRect bounds = tri.bounds & QRect(tile->x, tile->y, tile->width, tile->height);
+  if (bounds.isEmpty()) {
+    return;
+  }
+  const PolygonData& poly = mesh.polygons[tri.polygon];
+
+  // Evaluate the edge functions relative to the tile so that they keep
+  // their precision far from the origin.
+  Floats edgeA[3];
+  float edgeB[3], edgeC[3];
+  Mask ties[3];
+  for (int k = 0; k < 3; k++) {
+    edgeA[k] = splat(tri.a[k]);
+    edgeB[k] = tri.b[k];
+    edgeC[k] = tri.c[k] + tri.a[k] * tile->x + tri.b[k] * tile->y;
+    ties[k] = splatMask(tri.topLeft[k]);
+  }
+
+  Floats lanes;
+  for (int k = 0; k < LANES; k++) {
+    lanes[k] = k + 0.5f;
+  }
+  Floats width = splat(tile->width);
+  int firstX = (bounds.left() - tile->x) & ~(LANES - 1);
+  int lastX = bounds.right() - tile->x;
+  int lastY = bounds.bottom() - tile->y;
+  for (int y = bounds.top() - tile->y; y <= lastY; y++) {
+    float py = y + 0.5f;
+    for (int x = firstX; x <= lastX; x += LANES) {
+      int index = y * TILE_SIZE + x;
+      Floats px = lanes + float(x);
+      Mask inside = px < width;
+      for (int k = 0; k < 3; k++) {
+        Floats e = edgeA[k] * px + (edgeB[k] * py + edgeC[k]);
+        inside &= (e > splat(0)) | ((e == splat(0)) & ties[k]);
+      }
+
+      if (pass == MaskPass) {
+        storeMask(tile->stencil + index, loadMask(tile->stencil + index) | inside);
+        continue;
+      }
+
+      Floats imageX = px + float(tile->x);
+      Floats imageY = splat(py + tile->y);
+      Floats coverage = splat(1);
+      if (pass == CapPass) {
+        coverage = ellipseCoverage(tri, imageX, imageY);
+        inside &= coverage > splat(0);
+      } else {
+        inside &= ~loadMask(tile->stencil + index);
+      }
+      if (!any(inside)) {
+        continue;
+      }
+
+      Floats color[4];
+      evaluate(mesh, poly, imageX, imageY, color);
+      coverage = vmin(coverage, edgeCoverage(mesh, poly, imageX, imageY));
+      blend(tile, index, inside, color, coverage);
+    }
+  }
+}
+
+DL_SIMD_TARGETS
+void shadeTile(const QVector<CPURenderer::MeshData>& meshes, int tileIndex, Tile* tile)
+{
+  for (int c = 0; c < 4; c++) {
+    std::fill_n(tile->color[c], TILE_PIXELS, 0.0f);
+  }
+  bool stencilDirty = true;
+
+  for (const CPURenderer::MeshData& mesh : meshes) {
+    const QVector<int>& caps = mesh.capBins[tileIndex];
+    const QVector<int>& fans = mesh.fanBins[tileIndex];
+    if (caps.isEmpty() && fans.isEmpty()) {
+      continue;
+    }
+
+    // Each mesh is masked by its own caps only.
+    if (stencilDirty || !caps.isEmpty()) {
+      std::fill_n(tile->stencil, TILE_PIXELS, 0);
+      stencilDirty = !caps.isEmpty();
+    }
+    for (int i : caps) {
+      drawTriangle(mesh, mesh.caps[i], MaskPass, tile);
+    }
+    for (int i : caps) {
+      drawTriangle(mesh, mesh.caps[i], CapPass, tile);
+    }
+    for (int i : fans) {
+      drawTriangle(mesh, mesh.fans[i], FanPass, tile);
+    }
+  }
+}
+
+void writeTile(const Tile& tile, uchar* bits, int bytesPerLine)
+{
+  for (int y = 0; y < tile.height; y++) {
+    QRgb* line = reinterpret_cast<QRgb*>(bits + (tile.y + y) * bytesPerLine) + tile.x;
+    const int row = y * TILE_SIZE;
+    for (int x = 0; x < tile.width; x++) {
+      float a = qBound(0.0f, tile.color[3][row + x], 1.0f);
+      float r = qBound(0.0f, tile.color[0][row + x], a);
+      float g = qBound(0.0f, tile.color[1][row + x], a);
+      float b = qBound(0.0f, tile.color[2][row + x], a);
+      line[x] = qRgba(int(r * 255 + 0.5f), int(g * 255 + 0.5f), int(b * 255 + 0.5f), int(a * 255 + 0.5f));
+    }
+  }
+}
+
+struct TileGrid
+{
+  QVector<CPURenderer::MeshData> meshes;
+  QSize size;
+  int columns, rows;
+  uchar* bits;
+  int bytesPerLine;
+  QAtomicInt next;
+};
+
+// Each job takes tiles until there are none left, so that a few expensive
+// tiles don't hold up the rest.
+class TileJob : public QRunnable
+{
+public:
+  TileJob(TileGrid* grid)
+  : grid(grid)
+  {
+    // initializers only
+  }
+
+  void run() override
+  {
+    QScopedPointer<Tile> tile(new Tile);
+    int numTiles = grid->columns * grid->rows;
+    for (int i = grid->next.fetchAndAddRelaxed(1); i < numTiles; i = grid->next.fetchAndAddRelaxed(1)) {
+      tile->x = (i % grid->columns) * TILE_SIZE;
+      tile->y = (i / grid->columns) * TILE_SIZE;
+      tile->width = qMin(TILE_SIZE, grid->size.width() - tile->x);
+      tile->height = qMin(TILE_SIZE, grid->size.height() - tile->y);
+      shadeTile(grid->meshes, i, tile.data());
+      writeTile(*tile, grid->bits, grid->bytesPerLine);
+    }
+  }
+
+private:
+  TileGrid* grid;
+};
+
+}
+
+CPURenderer::CPURenderer()
+: m_threads(qMax(1, QThread::idealThreadCount()))
+{
+  // initializers only
+}
+
+int CPURenderer::threadCount() const
+{
+  return m_threads;
+}
+
+void CPURenderer::setThreadCount(int threads)
+{
+  m_threads = qMax(1, threads);
+}
+
+void CPURenderer::loadMesh(MeshItem* mesh, const QRectF& source, const QSizeF& scale, int tileColumns, int tileRows, MeshData* data)
+{
+  // This only brings the buffers' contents up to date. Nothing is uploaded
+  // until the mesh is drawn with OpenGL.
+  mesh->updateStorage();
+
+  QPointF origin = mesh->scenePos() - source.topLeft();
+  auto toImage = [&](const QVector2D& v) {
+    return QPointF((v.x() + origin.x()) * scale.width(), (v.y() + origin.y()) * scale.height());
+  };
+
+  const QVector<QVector2D>& verts = mesh->m_polyVerts.vector();
+  const QVector<QVector4D>& colors = mesh->m_polyColors.vector();
+  int numVerts = verts.length();
+  QPolygonF points(numVerts);
+  data->x.resize(numVerts);
+  data->y.resize(numVerts);
+  data->r.resize(numVerts);
+  data->g.resize(numVerts);
+  data->b.resize(numVerts);
+  data->a.resize(numVerts);
+  for (int i = 0; i < numVerts; i++) {
+    points[i] = toImage(verts[i]);
+    data->x[i] = points[i].x();
+    data->y[i] = points[i].y();
+    data->r[i] = colors[i].x();
+    data->g[i] = colors[i].y();
+    data->b[i] = colors[i].z();
+    data->a[i] = colors[i].w();
+  }
+  data->boundary = mesh->m_polyBoundary.vector();
+  data->boundary.resize(numVerts);
+
+  // Edge lengths are measured again in pixels, since the scale may differ
+  // between the axes.
+  data->edgeLength.resize(numVerts);
+  for (const QVector3D& info : mesh->m_polyInfo.vector()) {
+    PolygonData poly{ int(info.x()), int(info.y()), info.z() };
+    for (int i = 0; i < poly.count; i++) {
+      int j = i + 1 < poly.count ? i + 1 : 0;
+      QPointF edge = points[poly.offset + j] - points[poly.offset + i];
+      data->edgeLength[poly.offset + i] = std::hypot(edge.x(), edge.y());
+    }
+    data->polygons << poly;
+  }
+
+  int numTiles = tileColumns * tileRows;
+  QRect image(0, 0, tileColumns * TILE_SIZE, tileRows * TILE_SIZE);
+  data->fanBins.resize(numTiles);
+  data->capBins.resize(numTiles);
+
+  const QVector<QVector2D>& fanIndices = mesh->m_fanIndices.vector();
+  for (int k = 0; k + 2 < fanIndices.length(); k += 3) {
+    Triangle tri;
+    tri.polygon = int(fanIndices[k].x());
+    int offset = data->polygons[tri.polygon].offset;
+    QPointF corners[3];
+    for (int t = 0; t < 3; t++) {
+      corners[t] = points[offset + int(fanIndices[k + t].y())];
+    }
+    if (setupTriangle(&tri, corners)) {
+      binTriangle(tri, data->fans.length(), image, tileColumns, &data->fanBins);
+      data->fans << tri;
+    }
+  }
+
+  const QVector<BoundaryVertex>& boundaryVerts = mesh->m_boundaryVerts.vector();
+  for (int k = 0; k + 2 < boundaryVerts.length(); k += 3) {
+    const BoundaryVertex& v = boundaryVerts[k];
+    Triangle tri;
+    tri.polygon = int(v.polygon.x());
+    QPointF corners[3];
+    for (int t = 0; t < 3; t++) {
+      corners[t] = toImage(boundaryVerts[k + t].pos);
+    }
+    QPointF center = toImage(v.origin);
+    tri.origin[0] = center.x();
+    tri.origin[1] = center.y();
+    tri.inverseX[0] = v.inverseX.x() / scale.width();
+    tri.inverseX[1] = v.inverseX.y() / scale.width();
+    tri.inverseY[0] = v.inverseY.x() / scale.height();
+    tri.inverseY[1] = v.inverseY.y() / scale.height();
+    if (setupTriangle(&tri, corners)) {
+      binTriangle(tri, data->caps.length(), image, tileColumns, &data->capBins);
+      data->caps << tri;
+    }
+  }
+}
+
+QImage CPURenderer::render(const QList<MeshItem*>& meshes, const QSize& size, const QRectF& source) const
+{
+  QImage image(size, QImage::Format_ARGB32_Premultiplied);
+  if (image.isNull() || source.isEmpty()) {
+    qWarning("unable to render a %dx%d image", size.width(), size.height());
+    return QImage();
+  }
+
+  TileGrid grid;
+  grid.size = size;
+  grid.columns = (size.width() + TILE_SIZE - 1) / TILE_SIZE;
+  grid.rows = (size.height() + TILE_SIZE - 1) / TILE_SIZE;
+  QSizeF scale(size.width() / source.width(), size.height() / source.height());
+  grid.meshes.resize(meshes.length());
+  for (int i = 0; i < meshes.length(); i++) {
+    loadMesh(meshes[i], source, scale, grid.columns, grid.rows, &grid.meshes[i]);
+  }
+  // Detach before the jobs start writing to the pixels.
+  grid.bits = image.bits();
+  grid.bytesPerLine = image.bytesPerLine();
+
+  int jobs = qMin(m_threads, grid.columns * grid.rows);
+  QThreadPool pool;
+  pool.setMaxThreadCount(jobs);
+  for (int i = 0; i < jobs; i++) {
+    pool.start(new TileJob(&grid));
+  }
+  pool.waitForDone();
+  return image;
+}
@@ -0,0 +1,46 @@
+#ifndef DL_CPURENDERER_H
+#define DL_CPURENDERER_H
+
+#include <QImage>
+#include <QList>
+#include <QRectF>
+class MeshItem;
+
+// CPURenderer draws meshes without OpenGL. It evaluates the same mean value
+// coordinates as polyramp.fragment.glsl, with the same smooth corners and
+// analytic antialiasing, eight pixels at a time. The image is divided into
+// tiles, each mesh's triangles are binned by the tiles they touch, and the
+// tiles are shaded in parallel.
+//
+// The result matches an export from the OpenGL renderer without
+// multisampling to within TOLERANCE in every 8-bit channel. Pixel centers
+// that fall exactly on a triangle edge may be assigned to the other
+// triangle, which only matters where a polygon's fan extends past a concave
+// corner and can differ by more.
+class CPURenderer
+{
+public:
+  static const int TOLERANCE = 2;
+  static const int TILE_SIZE = 64;
+
+  CPURenderer();
+
+  // Defaults to QThread::idealThreadCount().
+  int threadCount() const;
+  void setThreadCount(int threads);
+
+  // Draws the meshes from bottom to top, mapping source, in scene
+  // coordinates, onto an image of the given size.
+  QImage render(const QList<MeshItem*>& meshes, const QSize& size, const QRectF& source) const;
+
+  // A mesh's geometry in image coordinates, binned by tile. Defined in
+  // cpurenderer.cpp.
+  struct MeshData;
+
+private:
+  static void loadMesh(MeshItem* mesh, const QRectF& source, const QSizeF& scale, int tileColumns, int tileRows, MeshData* data);
+
+  int m_threads;
+};
+
+#endif
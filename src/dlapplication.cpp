@@ -101,6 +101,33 @@ DLApplication::DLApplication(int argc, char** argv)
   addOption({
     QStringList{ "v", "version" }, tr("Displays version information.")
   });
+  addOption({
+    QStringList{ "validate-evaluator" }, tr("Renders each file with the fast and reference evaluators, reports the largest color difference, and exits.")
+  });
+  addOption({
+    QStringList{ "profile-csv" }, tr("Renders the file, writes the GPU time spent on each mesh and polygon to <csv>, and exits."), "csv"
+  });
+  addOption({
+    QStringList{ "export" }, tr("Renders the file to the image <output> and exits without opening a window. Use -platform offscreen on machines without a display."), "output"
+  });
+  addOption({
+    QStringList{ "batch" }, tr("Exports every file given as an argument or listed in --manifest, reports the time spent on each, and exits. Arguments may contain wildcards.")
+  });
+  addOption({
+    QStringList{ "manifest" }, tr("Adds the files listed in <manifest> to --batch. Each line names a file and optionally its output, separated by a tab."), "manifest"
+  });
+  addOption({
+    QStringList{ "output-dir" }, tr("Writes --batch outputs that aren't named in the manifest to <dir> instead of next to each file."), "dir"
+  });
+  addOption({
+    QStringList{ "dpi" }, tr("Sets the resolution of --export and --batch, in dots per inch. The default is 100."), "dpi"
+  });
+  addOption({
+    QStringList{ "format" }, tr("Sets the image format of --export and --batch, such as png or jpg. The default is based on the file name, or png for --batch."), "format"
+  });
+  addOption({
+    QStringList{ "cpu" }, tr("Renders --export and --batch on the CPU instead of with OpenGL.")
+  });
 }
 
 void DLApplication::addOption(const QCommandLineOption& opt)
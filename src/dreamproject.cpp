@@ -1,26 +1,44 @@
 #include "dreamproject.h"
 #include "meshitem.h"
-#include "glfunctions.h"
+#include "gpuprofiler.h"
+#include "cpurenderer.h"
+#include "imagestreamwriter.h"
+#include "meshlayeritem.h"
+#include "glbufferpool.h"
 #include <QPalette>
 #include <QPainter>
 #include <QOpenGLPaintDevice>
 #include <QOffscreenSurface>
+#include <QOpenGLContext>
 #include <QOpenGLFramebufferObject>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QFile>
+#include <QElapsedTimer>
+#include <QTextStream>
 #include <QApplication>
+#include <cstring>
 
 #define DPI 100
+// The largest tile rendered at once when exporting, in pixels on a side
+#define EXPORT_TILE_SIZE 2048
+// How scattered the free space in the vertex buffer pool can get before an
+// export compacts it. See GLBufferPool::Stats::fragmentation().
+#define POOL_FRAGMENTATION_LIMIT 0.5
 
 DreamProject::DreamProject(const QSizeF& pageSize, QObject* parent)
-: QGraphicsScene(parent), exporting(false)
+: QGraphicsScene(parent), exporting(false), exportSamples(0), backend(OpenGLBackend), zoom(1)
 {
   setBackgroundBrush(QColor(139,134,128,255));
 
   setPageSize(pageSize);
 }
 
+DreamProject::~DreamProject()
+{
+  releaseExportContext();
+}
+
 QSizeF DreamProject::pageSize() const
 {
   return pageRect.size() / DPI;
@@ -48,40 +66,379 @@ void DreamProject::drawBackground(QPainter* p, const QRectF& rect)
   p->drawRect(pageRect);
 }
 
-QImage DreamProject::render(int dpi)
+int DreamProject::exportSampleCount() const
+{
+  return exportSamples;
+}
+
+void DreamProject::setExportSampleCount(int samples)
+{
+  exportSamples = samples;
+}
+
+DreamProject::Backend DreamProject::renderBackend() const
+{
+  return backend;
+}
+
+void DreamProject::setRenderBackend(Backend backend)
+{
+  this->backend = backend;
+}
+
+bool DreamProject::makeExportContextCurrent()
+{
+  if (!exportContext) {
+    // With Qt::AA_ShareOpenGLContexts, sharing with the global context also
+    // shares with every viewport, so the meshes' buffers work in both.
+    QOpenGLContext* share = QOpenGLContext::globalShareContext();
+    if (!share) {
+      share = QOpenGLContext::currentContext();
+    }
+    exportSurface.reset(new QOffscreenSurface);
+    exportGL.reset(new GLFunctions(exportSurface.data()));
+    exportSurface->create();
+    exportContext.reset(new QOpenGLContext);
+    exportContext->setFormat(GLFunctions::defaultFormat());
+    exportContext->setShareContext(share);
+    if (!exportContext->create() || !exportContext->makeCurrent(exportSurface.data())) {
+      qWarning("unable to create an OpenGL context for exporting");
+      exportGL.reset();
+      exportContext.reset();
+      exportSurface.reset();
+      return false;
+    }
+    exportGL->initialize(exportContext.data());
+    return true;
+  }
+  return exportContext->makeCurrent(exportSurface.data());
+}
+
+void DreamProject::releaseExportContext()
+{
+  if (!exportContext) {
+    return;
+  }
+  QOpenGLContext* previous = QOpenGLContext::currentContext();
+  QSurface* previousSurface = previous ? previous->surface() : nullptr;
+  if (previous == exportContext.data()) {
+    previous = nullptr;
+  }
+  exportContext->makeCurrent(exportSurface.data());
+  exportFbo.reset();
+  exportGL.reset();
+  exportContext->doneCurrent();
+  exportContext.reset();
+  exportSurface.reset();
+  if (previous) {
+    previous->makeCurrent(previousSurface);
+  }
+}
+
+static QRectF tileSource(const QRectF& pageRect, const QSize& size, const QRect& tile)
+{
+  double scaleX = pageRect.width() / size.width();
+  double scaleY = pageRect.height() / size.height();
+  return QRectF(pageRect.left() + tile.x() * scaleX, pageRect.top() + tile.y() * scaleY, tile.width() * scaleX, tile.height() * scaleY);
+}
+
+bool DreamProject::renderTilesCPU(const QSize& size, const TileSink& sink)
+{
+  QList<MeshItem*> meshes;
+  for (MeshItem* mesh : filterItemsByType<MeshItem>(items(Qt::AscendingOrder))) {
+    if (mesh->isVisible()) {
+      meshes << mesh;
+    }
+  }
+
+  CPURenderer renderer;
+  for (int y = 0; y < size.height(); y += EXPORT_TILE_SIZE) {
+    for (int x = 0; x < size.width(); x += EXPORT_TILE_SIZE) {
+      QRect tile(x, y, qMin(EXPORT_TILE_SIZE, size.width() - x), qMin(EXPORT_TILE_SIZE, size.height() - y));
+      QImage image = renderer.render(meshes, tile.size(), tileSource(pageRect, size, tile));
+      if (image.isNull() || !sink(image, tile.topLeft())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool DreamProject::renderTiles(int dpi, const TileSink& sink, GLFunctions::EvaluatorTier evaluator, GPUProfiler* profiler)
+{
+  QSize size = (pageSize() * dpi).toSize();
+  if (size.isEmpty()) {
+    return false;
+  }
+  if (backend == CPUBackend && !profiler) {
+    return renderTilesCPU(size, sink);
+  }
+
+  QOpenGLContext* previous = QOpenGLContext::currentContext();
+  QSurface* previousSurface = previous ? previous->surface() : nullptr;
+  if (!makeExportContextCurrent()) {
+    if (profiler) {
+      return false;
+    }
+    qWarning("exporting with the CPU renderer instead");
+    return renderTilesCPU(size, sink);
+  }
+
+  // Compact the pool before any of the meshes' buffers are bound, so that
+  // the ones that move are respecified as they're drawn.
+  GLBufferPool* pool = GLBufferPool::instance(exportContext.data());
+  if (pool->stats().fragmentation() > POOL_FRAGMENTATION_LIMIT) {
+    pool->defragment();
+  }
+
+  GLFunctions& gl = *exportGL;
+  GLint maxTextureSize = 0, maxRenderbufferSize = 0;
+  gl.glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  gl.glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+  int maxTile = qMin(EXPORT_TILE_SIZE, qMin(maxTextureSize, maxRenderbufferSize));
+  QSize tileSize(qMin(size.width(), maxTile), qMin(size.height(), maxTile));
+  if (!exportFbo || exportFbo->size() != tileSize || exportFbo->format().samples() != exportSamples) {
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    format.setSamples(exportSamples);
+    exportFbo.reset(new QOpenGLFramebufferObject(tileSize, format));
+  }
+
+  gl.setEvaluatorTier(evaluator);
+  gl.setProfiler(profiler);
+  if (profiler) {
+    profiler->beginFrame();
+  }
+
+  bool ok = true;
+  for (int y = 0; ok && y < size.height(); y += tileSize.height()) {
+    for (int x = 0; ok && x < size.width(); x += tileSize.width()) {
+      // Every tile is drawn at full size. The ones on the right and bottom
+      // edges are cropped afterward.
+      QRectF source = tileSource(pageRect, size, QRect(QPoint(x, y), tileSize));
+      QPointF center = source.center();
+      exportFbo->bind();
+      gl.glViewport(0, 0, tileSize.width(), tileSize.height());
+      gl.glClearColor(0, 0, 0, 0);
+      gl.glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+      // Map this tile's part of the scene to output coordinates
+      gl.setTransform(QTransform(
+        2.0 / source.width(), 0, 0, -2.0 / source.height(),
+        -2.0 * center.x() / source.width(), 2.0 * center.y() / source.height()
+      ));
+
+      {
+        QOpenGLPaintDevice pd(tileSize);
+        QPainter p(&pd);
+
+        exporting = true;
+        QGraphicsScene::render(&p, QRectF(QPointF(0, 0), tileSize), source);
+        exporting = false;
+      }
+
+      QImage tile = exportFbo->toImage();
+      QSize visible(qMin(tileSize.width(), size.width() - x), qMin(tileSize.height(), size.height() - y));
+      if (visible != tileSize) {
+        tile = tile.copy(QRect(QPoint(0, 0), visible));
+      }
+      ok = sink(tile, QPoint(x, y));
+    }
+  }
+
+  if (profiler) {
+    // The queries belong to this context, so they have to be read now.
+    profiler->finish();
+  }
+  gl.setProfiler(nullptr);
+  exportFbo->release();
+  poolStats = pool->stats();
+
+  if (previous) {
+    previous->makeCurrent(previousSurface);
+  } else {
+    exportContext->doneCurrent();
+  }
+  return ok;
+}
+
+static void copyTile(QImage* image, const QImage& tile, const QPoint& offset)
 {
-  QOffscreenSurface surface;
-  QOpenGLContext ctx;
-  ctx.setShareContext(QOpenGLContext::currentContext());
-  ctx.create();
-  surface.create();
-  ctx.makeCurrent(&surface);
+  QImage pixels = tile.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  int bytes = pixels.width() * sizeof(QRgb);
+  for (int y = 0; y < pixels.height(); y++) {
+    std::memcpy(image->scanLine(offset.y() + y) + offset.x() * sizeof(QRgb), pixels.constScanLine(y), bytes);
+  }
+}
+
+QImage DreamProject::render(int dpi, GLFunctions::EvaluatorTier evaluator, GPUProfiler* profiler)
+{
+  QSize size = (pageSize() * dpi).toSize();
+  QImage image(size, QImage::Format_ARGB32_Premultiplied);
+  if (image.isNull()) {
+    qWarning("unable to allocate a %dx%d image", size.width(), size.height());
+    return QImage();
+  }
+  // So that formats with a resolution field record it
+  image.setDotsPerMeterX(qRound(dpi / 0.0254));
+  image.setDotsPerMeterY(qRound(dpi / 0.0254));
 
-  QSizeF size = pageSize() * dpi;
-  QOpenGLFramebufferObject fbo(size.toSize(), QOpenGLFramebufferObject::CombinedDepthStencil);
-  fbo.bind();
+  bool ok = renderTiles(dpi, [&image](const QImage& tile, const QPoint& offset) {
+    copyTile(&image, tile, offset);
+    return true;
+  }, evaluator, profiler);
+  return ok ? image : QImage();
+}
 
-  GLFunctions gl(&surface);
-  gl.initialize(&ctx);
+bool DreamProject::exportToFile(const QString& path, const QByteArray& format, int dpi, double* encodeMsecs)
+{
+  QByteArray streamFormat = format.isEmpty() ? ImageStreamWriter::formatForPath(path) : format;
+  if (!ImageStreamWriter::supportsFormat(streamFormat)) {
+    // Other formats are encoded from the whole image.
+    QImage rendered = render(dpi);
+    if (rendered.isNull()) {
+      return false;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = rendered.save(path, format.constData());
+    if (encodeMsecs) {
+      *encodeMsecs = timer.nsecsElapsed() / 1e6;
+    }
+    return ok;
+  }
 
-  // Map scene coordinates to output coordinates
-  gl.glViewport(0, 0, size.width(), size.height());
-  gl.setTransform(QTransform(2.0 / pageRect.width(), 0, 0, -2.0 / pageRect.height(), 0, 0));
+  // Each row of tiles is put together into a band and encoded while the
+  // next row renders.
+  QSize size = (pageSize() * dpi).toSize();
+  ImageStreamWriter writer(path, streamFormat, size, dpi);
+  if (!writer.open()) {
+    qWarning("%s: %s", qPrintable(path), qPrintable(writer.errorString()));
+    return false;
+  }
+  QImage band;
+  bool ok = renderTiles(dpi, [&](const QImage& tile, const QPoint& offset) {
+    if (offset.x() == 0) {
+      if (!band.isNull() && !writer.writeBand(band)) {
+        return false;
+      }
+      band = QImage(size.width(), tile.height(), QImage::Format_ARGB32_Premultiplied);
+      if (band.isNull()) {
+        return false;
+      }
+    }
+    copyTile(&band, tile, QPoint(offset.x(), 0));
+    return true;
+  });
+  ok = ok && writer.writeBand(band);
+  band = QImage();
+  if (!ok || !writer.close()) {
+    if (!writer.errorString().isEmpty()) {
+      qWarning("%s: %s", qPrintable(path), qPrintable(writer.errorString()));
+    }
+    writer.abort();
+    return false;
+  }
+  if (encodeMsecs) {
+    *encodeMsecs = writer.encodeMsecs();
+  }
+  return true;
+}
 
-  QOpenGLPaintDevice pd(size.toSize());
-  QPainter p(&pd);
+static int maxChannelError(const QImage& first, const QImage& second, QPoint* location)
+{
+  QImage reference = first.convertToFormat(QImage::Format_ARGB32);
+  QImage other = second.convertToFormat(QImage::Format_ARGB32);
+  if (reference.size() != other.size()) {
+    return 255;
+  }
 
-  exporting = true;
-  QGraphicsScene::render(&p, QRectF(QPointF(0, 0), size), pageRect);
-  exporting = false;
+  int maxError = 0;
+  int width = reference.width();
+  int height = reference.height();
+  for (int y = 0; y < height; y++) {
+    const QRgb* refLine = reinterpret_cast<const QRgb*>(reference.constScanLine(y));
+    const QRgb* otherLine = reinterpret_cast<const QRgb*>(other.constScanLine(y));
+    for (int x = 0; x < width; x++) {
+      QRgb a = refLine[x];
+      QRgb b = otherLine[x];
+      int error = qMax(
+        qMax(qAbs(qRed(a) - qRed(b)), qAbs(qGreen(a) - qGreen(b))),
+        qMax(qAbs(qBlue(a) - qBlue(b)), qAbs(qAlpha(a) - qAlpha(b)))
+      );
+      if (error > maxError) {
+        maxError = error;
+        if (location) {
+          *location = QPoint(x, y);
+        }
+      }
+    }
+  }
+  return maxError;
+}
 
-  return fbo.toImage();
+int DreamProject::evaluatorError(int dpi, QPoint* location)
+{
+  QImage reference = render(dpi, GLFunctions::ReferenceEvaluator);
+  QImage fast = render(dpi, GLFunctions::FastEvaluator);
+  return maxChannelError(reference, fast, location);
 }
 
-bool DreamProject::exportToFile(const QString& path, const QByteArray& format, int dpi)
+int DreamProject::backendError(int dpi, QPoint* location)
 {
-  QImage rendered = render(dpi);
-  return rendered.save(path, format.constData());
+  Backend oldBackend = backend;
+  backend = OpenGLBackend;
+  QImage gl = render(dpi);
+  backend = CPUBackend;
+  QImage cpu = render(dpi);
+  backend = oldBackend;
+  return maxChannelError(gl, cpu, location);
+}
+
+bool DreamProject::writeProfile(const QString& path, int dpi, int passes)
+{
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+    return false;
+  }
+
+  GPUProfiler profiler;
+  profiler.setDetail(GPUProfiler::PerPolygon);
+  for (int i = 0; i < passes; i++) {
+    render(dpi, GLFunctions::ReferenceEvaluator, &profiler);
+  }
+
+  QTextStream out(&file);
+  out << "mesh,polygon,vertices,samples,total_ms,mean_ms,max_ms\n";
+  QList<MeshItem*> meshes = itemsOfType<MeshItem>();
+  int numMeshes = meshes.length();
+  for (int m = 0; m < numMeshes; m++) {
+    MeshItem* mesh = meshes[m];
+    int numPolygons = mesh->polygonCount();
+    for (int i = -1; i < numPolygons; i++) {
+      GPUTiming timing = profiler.timing(mesh, i);
+      if (!timing.frames) {
+        continue;
+      }
+      int vertices = 0;
+      if (i < 0) {
+        for (int j = 0; j < numPolygons; j++) {
+          vertices += mesh->polygonSize(j);
+        }
+      } else {
+        vertices = mesh->polygonSize(i);
+      }
+      out << m << "," << (i < 0 ? QString() : QString::number(i)) << "," << vertices << "," << timing.frames << ","
+          << timing.totalMsecs << "," << (timing.totalMsecs / timing.frames) << "," << timing.maxMsecs << "\n";
+    }
+  }
+  out.flush();
+  return file.error() == QFileDevice::NoError;
+}
+
+GLBufferPool::Stats DreamProject::bufferPoolStats() const
+{
+  return poolStats;
 }
 
 bool DreamProject::isExporting() const
@@ -89,7 +446,23 @@ bool DreamProject::isExporting() const
   return exporting;
 }
 
-void DreamProject::open(const QString& path)
+double DreamProject::viewScale() const
+{
+  return zoom;
+}
+
+void DreamProject::setViewScale(double scale)
+{
+  if (scale == zoom) {
+    return;
+  }
+  zoom = scale;
+  for (MeshLayerItem* layer : itemsOfType<MeshLayerItem>()) {
+    layer->setViewScale(scale);
+  }
+}
+
+QJsonDocument DreamProject::readDocument(const QString& path)
 {
   QFile f(path);
   if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
@@ -101,7 +474,16 @@ void DreamProject::open(const QString& path)
   if (doc.isNull()) {
     throw OpenException(err.errorString());
   }
+  return doc;
+}
+
+void DreamProject::open(const QString& path)
+{
+  load(readDocument(path));
+}
 
+void DreamProject::load(const QJsonDocument& doc)
+{
   QJsonObject pageSize = doc["page"].toObject();
   // If page size is not set, use a default
   setPageSize(QSizeF(pageSize["width"].toInt(8.5), pageSize["height"].toInt(11)));
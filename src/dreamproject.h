@@ -2,8 +2,17 @@
 #define DL_DREAMPROJECT_H
 
 #include <QGraphicsScene>
+#include <QScopedPointer>
+#include <QJsonDocument>
 #include <stdexcept>
+#include <functional>
+#include "glfunctions.h"
+#include "glbufferpool.h"
 class QGraphicsRectItem;
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+class GPUProfiler;
 
 class OpenException : public std::runtime_error
 {
@@ -22,17 +31,68 @@ class DreamProject : public QGraphicsScene
 Q_OBJECT
 public:
   DreamProject(const QSizeF& pageSize, QObject* parent = nullptr);
+  ~DreamProject();
 
   QSizeF pageSize() const;
   void setPageSize(const QSizeF& size);
 
+  // Reading and parsing a file doesn't touch the scene, so it can be done
+  // on another thread. load() adds the document's meshes to the project.
+  static QJsonDocument readDocument(const QString& path);
   void open(const QString& path);
+  void load(const QJsonDocument& doc);
   void save(const QString& path);
 
-  QImage render(int dpi = 100);
-  bool exportToFile(const QString& path, const QByteArray& format = QByteArray(), int dpi = 100);
+  // The number of samples per pixel used for exports. Mesh boundaries are
+  // antialiased in the shader regardless.
+  int exportSampleCount() const;
+  void setExportSampleCount(int samples);
+
+  enum Backend {
+    OpenGLBackend,
+    CPUBackend,
+  };
+
+  // The renderer used by render() and exportToFile(). The OpenGL backend
+  // falls back to the CPU if it can't create a context, and profiling
+  // always uses OpenGL.
+  Backend renderBackend() const;
+  void setRenderBackend(Backend backend);
+
+  QImage render(int dpi = 100, GLFunctions::EvaluatorTier evaluator = GLFunctions::ReferenceEvaluator, GPUProfiler* profiler = nullptr);
+  // Receives each tile of the page and where it goes in the output, row by
+  // row from the top left. Returning false stops rendering.
+  using TileSink = std::function<bool(const QImage& tile, const QPoint& offset)>;
+  // Renders the page in tiles no larger than 2048 pixels or the GPU's
+  // limits, so that the framebuffer doesn't grow with the output. render()
+  // puts the tiles back together.
+  bool renderTiles(int dpi, const TileSink& sink, GLFunctions::EvaluatorTier evaluator = GLFunctions::ReferenceEvaluator, GPUProfiler* profiler = nullptr);
+  // If encodeMsecs is given, it's set to the time spent encoding the image.
+  bool exportToFile(const QString& path, const QByteArray& format = QByteArray(), int dpi = 100, double* encodeMsecs = nullptr);
+  // render() uses a context of its own, created on first use and shared with
+  // the viewport's when possible. It keeps its programs, framebuffer and the
+  // meshes' GPU buffers between exports until this is called.
+  void releaseExportContext();
+
+  // Renders the project with the fast and reference evaluators and returns
+  // the largest difference in any color channel, from 0 to 255.
+  int evaluatorError(int dpi = 100, QPoint* location = nullptr);
+  // Renders the project with both backends and returns the largest
+  // difference in any color channel. See CPURenderer::TOLERANCE.
+  int backendError(int dpi = 100, QPoint* location = nullptr);
+  // Renders the project several times, timing each mesh and polygon on the
+  // GPU, and writes the results to a CSV file.
+  bool writeProfile(const QString& path, int dpi = 100, int passes = 5);
+  // How full and how fragmented the pool that the meshes' vertex buffers
+  // come from was at the end of the last export with OpenGL
+  GLBufferPool::Stats bufferPoolStats() const;
   bool isExporting() const;
 
+  // The editor's zoom level, which sizes the margins of the meshes' grip
+  // and edge layers
+  double viewScale() const;
+  void setViewScale(double scale);
+
   template <typename ItemType>
   static QList<ItemType*> filterItemsByType(const QList<QGraphicsItem*>& items)
   {
@@ -68,8 +128,20 @@ protected:
   void drawBackground(QPainter* p, const QRectF& rect);
 
 private:
+  bool makeExportContextCurrent();
+  bool renderTilesCPU(const QSize& size, const TileSink& sink);
+
   QRectF pageRect;
   bool exporting;
+  int exportSamples;
+  Backend backend;
+  GLBufferPool::Stats poolStats;
+  double zoom;
+
+  QScopedPointer<QOffscreenSurface> exportSurface;
+  QScopedPointer<QOpenGLContext> exportContext;
+  QScopedPointer<GLFunctions> exportGL;
+  QScopedPointer<QOpenGLFramebufferObject> exportFbo;
 };
 
 #endif
@@ -8,11 +8,12 @@
 #include <QPainter>
 
 EdgeItem::EdgeItem(GripItem* left, GripItem* right)
-: QObject(nullptr), QGraphicsLineItem(QLineF(left->pos(), right->pos()), left->parentItem()), left(left), right(right)
+: QObject(nullptr), QGraphicsLineItem(QLineF(left->pos(), right->pos()), left->parentItem()), left(left), right(right), hovered(false)
 {
   setAcceptHoverEvents(true);
   hoverLeaveEvent(nullptr);
   setZValue(0.1);
+  setFlag(QGraphicsItem::ItemHasNoContents, dynamic_cast<MeshItem*>(parentItem()) != nullptr);
 
   QObject::connect(left, SIGNAL(moved(GripItem*, QPointF)), this, SLOT(updateVertices()));
   QObject::connect(right, SIGNAL(moved(GripItem*, QPointF)), this, SLOT(updateVertices()));
@@ -40,30 +41,46 @@ QPainterPath EdgeItem::shape() const
   return path;
 }
 
-void EdgeItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
+QVariant EdgeItem::itemChange(QGraphicsItem::GraphicsItemChange change, const QVariant& value)
 {
-  MeshItem* mesh = dynamic_cast<MeshItem*>(parentItem());
-  if (mesh && !mesh->edgesVisible()) {
-    return;
+  if (change == ItemParentHasChanged) {
+    // Meshes draw all of their edges at once.
+    setFlag(QGraphicsItem::ItemHasNoContents, dynamic_cast<MeshItem*>(parentItem()) != nullptr);
   }
-  QPen p = pen();
-  p.setCosmetic(true);
-  painter->setPen(p);
+  return value;
+}
+
+void EdgeItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
+{
+  // Only reached for edges outside of a mesh; the others are drawn by the
+  // mesh's EdgeLayerItem.
+  QPen pen(Qt::black, hovered ? 3 : 0);
+  pen.setCosmetic(true);
+  painter->setPen(pen);
   painter->drawLine(line());
 }
 
+bool EdgeItem::isHovered() const
+{
+  return hovered;
+}
+
 void EdgeItem::hoverEnter()
 {
-  QPen pen(Qt::black, 3);
-  pen.setCosmetic(true);
-  setPen(pen);
+  if (!hovered) {
+    hovered = true;
+    update();
+    emit hoverChanged(this, true);
+  }
 }
 
 void EdgeItem::hoverLeave()
 {
-  QPen pen(Qt::black, 0);
-  pen.setCosmetic(true);
-  setPen(pen);
+  if (hovered) {
+    hovered = false;
+    update();
+    emit hoverChanged(this, false);
+  }
 }
 
 void EdgeItem::split(const QPointF& pos)
@@ -26,13 +26,16 @@ public:
 
   QColor colorAt(const QPointF& pos) const;
 
+  bool isHovered() const;
   void hoverEnter();
   void hoverLeave();
 
 signals:
   void insertVertex(EdgeItem*, const QPointF&);
+  void hoverChanged(EdgeItem*, bool);
 
 protected:
+  QVariant itemChange(QGraphicsItem::GraphicsItemChange change, const QVariant& value);
   void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget);
 
 protected slots:
@@ -41,6 +44,7 @@ protected slots:
 private:
   GripItem* left;
   GripItem* right;
+  bool hovered;
 };
 
 #endif
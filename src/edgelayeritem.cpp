@@ -0,0 +1,163 @@
+#include "edgelayeritem.h"
+#include "meshitem.h"
+#include "gripitem.h"
+#include "edgeitem.h"
+#include "dreamproject.h"
+#include "glfunctions.h"
+#include <QOpenGLContext>
+#include <QStyleOptionGraphicsItem>
+#include <QPainter>
+
+// Half the width of an edge, in pixels, and of one under the cursor
+static const double EDGE_HALF_WIDTH = 0.5;
+static const double HOVER_HALF_WIDTH = 1.5;
+
+EdgeLayerItem::EdgeLayerItem(MeshItem* mesh)
+: MeshLayerItem(mesh, HOVER_HALF_WIDTH)
+{
+  // Above the mesh, below the grips
+  setZValue(0.1);
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+  setAcceptedMouseButtons(Qt::NoButton);
+
+  instances.setAttributeBuffer(0, &lines, 0, -1, 1);
+  instances.setAttributeBuffer(1, &hovered, 0, -1, 1);
+}
+
+QRectF EdgeLayerItem::boundingRect() const
+{
+  return edgeRect.adjusted(-margin, -margin, margin, margin);
+}
+
+// The area covered by a line, including its width
+QRectF EdgeLayerItem::lineRect(int index) const
+{
+  const QVector4D& line = lines[index];
+  return QRectF(QPointF(line.x(), line.y()), QPointF(line.z(), line.w())).normalized()
+    .adjusted(-margin, -margin, margin, margin);
+}
+
+static QVector4D edgeLine(EdgeItem* edge)
+{
+  QPointF p1 = edge->leftGrip()->pos();
+  QPointF p2 = edge->rightGrip()->pos();
+  return QVector4D(p1.x(), p1.y(), p2.x(), p2.y());
+}
+
+void EdgeLayerItem::updateVertex(GripItem* vertex)
+{
+  for (int index : vertexEdges.values(vertex)) {
+    // Erase the line where it was drawn before.
+    update(lineRect(index));
+    lines[index] = edgeLine(edgeList[index]);
+    QRectF rect = lineRect(index);
+    if (!boundingRect().contains(rect)) {
+      prepareGeometryChange();
+      edgeRect |= rect.adjusted(margin, margin, -margin, -margin);
+    }
+    update(rect);
+  }
+}
+
+void EdgeLayerItem::setHovered(EdgeItem* edge, bool on)
+{
+  int index = edgeIndex.value(edge, -1);
+  if (index < 0 || (hovered.vector()[index] > 0) == on) {
+    return;
+  }
+  hovered[index] = on ? 1 : 0;
+  update(lineRect(index));
+}
+
+void EdgeLayerItem::updateGeometry()
+{
+  prepareGeometryChange();
+  edgeList.clear();
+  edgeIndex.clear();
+  vertexEdges.clear();
+  QVector<QVector4D> newLines;
+  QVector<GLfloat> newHovered;
+  QPolygonF ends;
+  for (EdgeItem* edge : mesh->edges()) {
+    // Edges that aren't in the mesh yet draw themselves.
+    if (edge->parentItem() != mesh) {
+      continue;
+    }
+    int index = edgeList.length();
+    edgeList << edge;
+    edgeIndex[edge] = index;
+    vertexEdges.insert(edge->leftGrip(), index);
+    vertexEdges.insert(edge->rightGrip(), index);
+    newLines << edgeLine(edge);
+    newHovered << (edge->isHovered() ? 1 : 0);
+    ends << edge->leftGrip()->pos() << edge->rightGrip()->pos();
+  }
+  lines = newLines;
+  hovered = newHovered;
+  edgeRect = ends.boundingRect();
+  update();
+}
+
+void EdgeLayerItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget*)
+{
+  if (DreamProject* project = dynamic_cast<DreamProject*>(scene())) {
+    if (project->isExporting()) {
+      return;
+    }
+  }
+  if (edgeList.isEmpty() || !mesh->edgesVisible()) {
+    return;
+  }
+
+  painter->beginNativePainting();
+  GLFunctions* gl = GLFunctions::instance(QOpenGLContext::currentContext());
+  if (gl) {
+    QTransform transform = gl->transform();
+    QPointF origin = scenePos();
+    QPointF translate(transform.dx() + origin.x() * transform.m11(), transform.dy() + origin.y() * transform.m22());
+    GLint viewport[4];
+    gl->glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Lines outside the exposed area are clipped rather than culled, since
+    // the whole buffer is drawn at once.
+    GLboolean hadScissor = gl->glIsEnabled(GL_SCISSOR_TEST);
+    GLint oldScissorBox[4];
+    gl->glGetIntegerv(GL_SCISSOR_BOX, oldScissorBox);
+    QRect clip = gl->deviceRect(mapRectToScene(option->exposedRect));
+    if (hadScissor) {
+      clip &= QRect(oldScissorBox[0], oldScissorBox[1], oldScissorBox[2], oldScissorBox[3]);
+    }
+    gl->glEnable(GL_SCISSOR_TEST);
+    gl->glScissor(clip.x(), clip.y(), clip.width(), clip.height());
+
+    GLboolean hadBlend = gl->glIsEnabled(GL_BLEND);
+    GLint oldBlend[4];
+    gl->glGetIntegerv(GL_BLEND_SRC_RGB, &oldBlend[0]);
+    gl->glGetIntegerv(GL_BLEND_DST_RGB, &oldBlend[1]);
+    gl->glGetIntegerv(GL_BLEND_SRC_ALPHA, &oldBlend[2]);
+    gl->glGetIntegerv(GL_BLEND_DST_ALPHA, &oldBlend[3]);
+    gl->glEnable(GL_BLEND);
+    gl->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    {
+      BoundProgram program = gl->useShader("edges");
+      program->setUniformValue("translate", translate);
+      program->setUniformValue("scale", transform.m11(), transform.m22());
+      program->setUniformValue("viewportSize", QPointF(viewport[2], viewport[3]));
+      program->setUniformValue("halfWidths", EDGE_HALF_WIDTH, HOVER_HALF_WIDTH);
+      program->setUniformValue("lineColor", QColor(Qt::black));
+      program.bindVertexArray(instances);
+      gl->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, lines.count());
+    }
+
+    gl->glBlendFuncSeparate(oldBlend[0], oldBlend[1], oldBlend[2], oldBlend[3]);
+    if (!hadBlend) {
+      gl->glDisable(GL_BLEND);
+    }
+    gl->glScissor(oldScissorBox[0], oldScissorBox[1], oldScissorBox[2], oldScissorBox[3]);
+    if (!hadScissor) {
+      gl->glDisable(GL_SCISSOR_TEST);
+    }
+  }
+  painter->endNativePainting();
+}
@@ -0,0 +1,48 @@
+#ifndef DL_EDGELAYERITEM_H
+#define DL_EDGELAYERITEM_H
+
+#include <QHash>
+#include <QMultiHash>
+#include <QVector>
+#include "glbuffer.h"
+#include "vertexarray.h"
+#include "meshlayeritem.h"
+class MeshItem;
+class GripItem;
+class EdgeItem;
+
+// EdgeLayerItem draws all of a mesh's edges with one instanced draw call
+// from a persistent line buffer. Moving a vertex only rewrites the edges
+// that touch it, and highlighting an edge only changes its hover flag.
+// The EdgeItems stay in the scene for hit testing.
+class EdgeLayerItem : public MeshLayerItem
+{
+public:
+  EdgeLayerItem(MeshItem* mesh);
+
+  QRectF boundingRect() const;
+  void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget);
+
+  // Rewrites the edges that end at vertex after it moves.
+  void updateVertex(GripItem* vertex);
+  void setHovered(EdgeItem* edge, bool on);
+  // Rebuilds the line buffer. Call when edges are added or split.
+  void updateGeometry();
+
+private:
+  QRectF lineRect(int index) const;
+
+  // The edges in the order they appear in the line buffer
+  QVector<EdgeItem*> edgeList;
+  QHash<EdgeItem*, int> edgeIndex;
+  QMultiHash<GripItem*, int> vertexEdges;
+  // The bounding rect of the edges
+  QRectF edgeRect;
+
+  // x1, y1, x2, y2 for each edge
+  GLBuffer<QVector4D> lines;
+  GLBuffer<GLfloat> hovered;
+  VertexArray instances;
+};
+
+#endif
@@ -1,12 +1,12 @@
 #include "editorview.h"
 #include "glviewport.h"
+#include "ringoverlay.h"
 #include "gripitem.h"
 #include "edgeitem.h"
 #include "meshitem.h"
 #include "tool.h"
 #include <QAction>
 #include <QGraphicsScene>
-#include <QGraphicsRectItem>
 #include <QScrollBar>
 #include <QWheelEvent>
 #include <QGestureEvent>
@@ -37,15 +37,24 @@ SaveException::SaveException(const QString& what)
 }
 
 EditorView::EditorView(QWidget* parent)
-: QGraphicsView(parent), isPanning(false), isResizingRing(false), containsMouse(false), useRing(true),
-  ringSize(20), currentTool(nullptr), underCursor(nullptr)
+: QGraphicsView(parent), motionThrottled(false), isPanning(false), isResizingRing(false), containsMouse(false), useRing(true),
+  ringSize(20), currentTool(nullptr)
 {
   glViewport = new GLViewport(this);
   glViewport->grabGesture(Qt::PinchGesture);
   setMouseTracking(true);
   glViewport->setMouseTracking(true);
+  glViewport->setEvaluatorTier(m_evaluatorTier);
+  ringOverlay = new RingOverlay(glViewport);
+  ringOverlay->hide();
 
   setViewport(glViewport);
+
+  // If nothing ends up being drawn, don't wait for a swap that won't come.
+  motionTimer.setSingleShot(true);
+  motionTimer.setInterval(16);
+  QObject::connect(&motionTimer, SIGNAL(timeout()), this, SLOT(releaseMotion()));
+  QObject::connect(glViewport, SIGNAL(frameSwapped()), this, SLOT(releaseMotion()));
   setTransformationAnchor(QGraphicsView::NoAnchor);
   setDragMode(NoDrag);
   setCursor(Qt::BlankCursor);
@@ -63,14 +72,8 @@ void EditorView::newProject()
   QGraphicsScene* oldScene = scene();
 
   projectScene = new DreamProject(QSizeF(8.5, 11), this);
+  projectScene->setViewScale(transform().m11());
   setScene(projectScene);
-
-  underCursor = new QGraphicsRectItem(-3, -3, 6, 6);
-  underCursor->setPen(QColor(Qt::transparent));
-  underCursor->setFlag(QGraphicsItem::ItemIsMovable, true);
-  underCursor->setFlag(QGraphicsItem::ItemIgnoresTransformations, true);
-  underCursor->setZValue(HUGE_VAL);
-  projectScene->addItem(underCursor);
   setCursorFromTool();
 
   delete oldScene;
@@ -95,6 +98,8 @@ bool EditorView::viewportEvent(QEvent* event)
 
 void EditorView::pinchGesture(QPinchGesture* gesture)
 {
+  glViewport->markInteraction();
+
   // The first touch might have started a drag. Cancel it if so.
   setDragMode(NoDrag);
 
@@ -105,12 +110,21 @@ void EditorView::pinchGesture(QPinchGesture* gesture)
 
   double factor = gesture->scaleFactor();
   if (factor != 1.0) {
-    scale(factor, factor);
+    zoomBy(factor);
   }
 }
 
+// Scales the view and tells the project, so that the grip and edge layers
+// can resize their margins before they're painted.
+void EditorView::zoomBy(double factor)
+{
+  scale(factor, factor);
+  projectScene->setViewScale(transform().m11());
+}
+
 void EditorView::mousePressEvent(QMouseEvent* event)
 {
+  flushMotion();
   if (isPanning) {
     // While using a middle-drag, don't process other clicks
     return;
@@ -140,6 +154,28 @@ void EditorView::mousePressEvent(QMouseEvent* event)
 }
 
 void EditorView::mouseMoveEvent(QMouseEvent* event)
+{
+  if (isPanning || (event->buttons() & Qt::LeftButton)) {
+    glViewport->markInteraction();
+  }
+
+  bool everyMotion = currentTool && currentTool->needsEveryMotion();
+#if ALT_RING_MODE == 2
+  // Resizing the ring works on relative movement.
+  everyMotion = everyMotion || isResizingRing;
+#endif
+  if (everyMotion) {
+    flushMotion();
+    processMotion(event);
+  } else if (motionThrottled) {
+    pendingMotion.reset(new QMouseEvent(event->type(), event->localPos(), event->windowPos(), event->screenPos(),
+                                        event->button(), event->buttons(), event->modifiers()));
+  } else {
+    processMotion(event);
+  }
+}
+
+void EditorView::processMotion(QMouseEvent* event)
 {
   if (isPanning) {
     QPoint delta = dragStart - event->pos();
@@ -177,10 +213,34 @@ void EditorView::mouseMoveEvent(QMouseEvent* event)
     }
   }
   updateMouseRect();
+
+  motionThrottled = true;
+  motionTimer.start();
+}
+
+void EditorView::releaseMotion()
+{
+  motionThrottled = false;
+  motionTimer.stop();
+  if (pendingMotion) {
+    QScopedPointer<QMouseEvent> event(pendingMotion.take());
+    processMotion(event.data());
+  }
+}
+
+// Handles any motion that is still waiting so that it isn't reordered with
+// other input.
+void EditorView::flushMotion()
+{
+  if (pendingMotion) {
+    QScopedPointer<QMouseEvent> event(pendingMotion.take());
+    processMotion(event.data());
+  }
 }
 
 void EditorView::mouseReleaseEvent(QMouseEvent* event)
 {
+  flushMotion();
   bool handled = false;
   if (event->button() == Qt::MiddleButton) {
     isPanning = false;
@@ -211,12 +271,14 @@ void EditorView::enterEvent(QEvent*)
 
 void EditorView::leaveEvent(QEvent*)
 {
+  pendingMotion.reset();
   containsMouse = false;
   updateMouseRect();
 }
 
 void EditorView::wheelEvent(QWheelEvent* event)
 {
+  glViewport->markInteraction();
   if (event->modifiers() & Qt::ControlModifier) {
     double zoom = transform().m11();
     QPoint mousePos = event->position().toPoint();
@@ -233,7 +295,7 @@ void EditorView::wheelEvent(QWheelEvent* event)
     } else if (zoom * factor > 100.0) {
       factor = 100.0 / zoom;
     }
-    scale(factor, factor);
+    zoomBy(factor);
     QPointF newPos = mapToScene(mousePos);
     QPointF delta = newPos - oldPos;
     translate(delta.x(), delta.y());
@@ -242,44 +304,23 @@ void EditorView::wheelEvent(QWheelEvent* event)
   QGraphicsView::wheelEvent(event);
 }
 
-void EditorView::updateMouseRect()
+void EditorView::paintEvent(QPaintEvent* event)
 {
-  QPointF center = cursorPos();
-  underCursor->setPos(center);
-  QRectF mouseRect(center.x() - ringSize - 1.5, center.y() - ringSize - 1.5, 2 * ringSize + 3, 2 * ringSize + 3);
-  updateScene({ mouseRect, lastMouseRect });
-  lastMouseRect = mouseRect;
+  glViewport->beginFrame();
+  QGraphicsView::paintEvent(event);
+  glViewport->endFrame();
 }
 
-void EditorView::drawForeground(QPainter* p, const QRectF& rect)
+void EditorView::updateMouseRect()
 {
-  QGraphicsView::drawForeground(p, rect);
-  if (isPanning || !containsMouse || !useRing) {
-    return;
-  }
-  p->resetTransform();
+  // The ring is drawn on an overlay, so moving it doesn't repaint the scene.
+  ringOverlay->setVisible(containsMouse && useRing && !isPanning);
 #if ALT_RING_MODE
-  QPointF center = mapFromGlobal(isResizingRing ? dragStart : QCursor::pos());
+  QPointF center = glViewport->mapFromGlobal(isResizingRing ? dragStart : QCursor::pos());
 #else
-  QPointF center = mapFromGlobal(QCursor::pos());
+  QPointF center = glViewport->mapFromGlobal(QCursor::pos());
 #endif
-  p->setRenderHint(QPainter::Antialiasing);
-  p->setPen(QPen(Qt::black, 4));
-  p->drawEllipse(center, ringSize, ringSize);
-  p->setPen(QPen(Qt::white, 2));
-  p->drawEllipse(center, ringSize, ringSize);
-  p->setPen(QPen(QColor(128, 128, 128), 1.5));
-  p->drawEllipse(center + QPointF(0.5, 0.5), ringSize, ringSize);
-  p->setPen(QPen(Qt::white, 1));
-  p->drawEllipse(center - QPointF(0.5, 0.5), ringSize, ringSize);
-  /*
-  if (isResizingRing) {
-    QPen pen(Qt::black, 0);
-    pen.setCosmetic(true);
-    p->setPen(pen);
-    p->drawLine(center, mapFromGlobal(dragStart));
-  }
-  */
+  ringOverlay->setRing(center, ringSize);
 }
 
 void EditorView::contextMenu(const QPoint& pos)
@@ -359,19 +400,13 @@ void EditorView::setCursorFromTool()
     if (shape != Qt::BitmapCursor) {
       setCursor(shape);
       useRing = false;
-      if (underCursor) {
-        underCursor->hide();
-        updateMouseRect();
-      }
+      updateMouseRect();
       return;
     }
   }
   setCursor(Qt::BlankCursor);
   useRing = true;
-  if (underCursor) {
-    underCursor->show();
-    updateMouseRect();
-  }
+  updateMouseRect();
 }
 
 QList<QGraphicsItem*> EditorView::itemsInRing() const
@@ -493,6 +528,44 @@ bool EditorView::isPreview() const
 void EditorView::setPreview(bool on)
 {
   m_preview = on;
+  glViewport->setEvaluatorTier(on ? GLFunctions::ReferenceEvaluator : m_evaluatorTier);
+  updateScene({ mapToScene(rect()).boundingRect() });
+}
+
+GLFunctions::EvaluatorTier EditorView::evaluatorTier() const
+{
+  return m_evaluatorTier;
+}
+
+void EditorView::setEvaluatorTier(GLFunctions::EvaluatorTier tier)
+{
+  m_evaluatorTier = tier;
+  setPreview(m_preview);
+}
+
+bool EditorView::dynamicResolution() const
+{
+  return glViewport->dynamicResolution();
+}
+
+void EditorView::setDynamicResolution(bool on)
+{
+  glViewport->setDynamicResolution(on);
+}
+
+void EditorView::setFrameBudget(double msecs)
+{
+  glViewport->setFrameBudget(msecs);
+}
+
+void EditorView::setSampleCount(int samples)
+{
+  glViewport->setSampleCount(samples);
+}
+
+void EditorView::setAnalyticAntialiasing(bool on)
+{
+  glViewport->setAnalyticAntialiasing(on);
   updateScene({ mapToScene(rect()).boundingRect() });
 }
 
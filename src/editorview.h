@@ -4,11 +4,15 @@
 #include <QMouseEvent>
 #include <QGraphicsView>
 #include <QElapsedTimer>
+#include <QTimer>
+#include <QScopedPointer>
 #include <QPainterPath>
 #include "tool.h"
 #include "dreamproject.h"
+#include "glfunctions.h"
 class QPinchGesture;
 class GLViewport;
+class RingOverlay;
 class GripItem;
 class EdgeItem;
 class MeshItem;
@@ -54,6 +58,12 @@ public:
   void setVerticesVisible(bool on);
 
   bool isPreview() const;
+  bool dynamicResolution() const;
+  GLFunctions::EvaluatorTier evaluatorTier() const;
+  void setEvaluatorTier(GLFunctions::EvaluatorTier tier);
+  void setFrameBudget(double msecs);
+  void setSampleCount(int samples);
+  void setAnalyticAntialiasing(bool on);
 
   DreamProject* project() const;
 
@@ -62,6 +72,7 @@ public:
 
 public slots:
   void setPreview(bool on);
+  void setDynamicResolution(bool on);
   void setTool(QAction* toolAction);
   void setTool(Tool::Type type);
   void setActiveVertex(GripItem* vertex);
@@ -81,27 +92,39 @@ protected:
   void enterEvent(QEvent*);
   void leaveEvent(QEvent*);
   void wheelEvent(QWheelEvent* event);
-  void drawForeground(QPainter* p, const QRectF& rect);
+  void paintEvent(QPaintEvent* event);
+
+private slots:
+  void releaseMotion();
 
 private:
   void pinchGesture(QPinchGesture* gesture);
+  void zoomBy(double factor);
+  void processMotion(QMouseEvent* event);
+  void flushMotion();
   void updateMouseRect();
   void setCursorFromTool();
 
   void contextMenu(const QPoint& pos);
 
   QElapsedTimer timer;
+  // Mouse motion is handled at most once per frame. Positions that arrive
+  // in between replace each other until the frame is on screen.
+  QScopedPointer<QMouseEvent> pendingMotion;
+  bool motionThrottled;
+  QTimer motionTimer;
   GLViewport* glViewport;
+  RingOverlay* ringOverlay;
   DreamProject* projectScene;
   bool isPanning, isResizingRing, containsMouse, useRing;
   bool m_edgesVisible = true;
   bool m_verticesVisible = true;
   bool m_preview = false;
+  // Preview always uses the reference evaluator, like exports do.
+  GLFunctions::EvaluatorTier m_evaluatorTier = GLFunctions::FastEvaluator;
   float ringSize, originalRingSize;
   QPoint dragStart, lastDrag;
-  QRectF lastMouseRect;
   Tool* currentTool;
-  QGraphicsRectItem* underCursor;
   QColor lastColor;
   QAction* m_colorAction;
 };
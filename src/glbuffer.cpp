@@ -1,25 +1,203 @@
 #include "glbuffer.h"
+#include "glbufferpool.h"
+#include <QOpenGLContext>
+#include <QOpenGLTexture>
 
-GLBufferBase::GLBufferBase(int glType, QOpenGLBuffer::Type type)
-: QOpenGLBuffer(type), m_dirty(true), m_glType(glType)
+// Past this many separate ranges, it's cheaper to upload them as one.
+static const int MAX_DIRTY_RANGES = 16;
+
+static quint64 glBufferBytesUploaded = 0;
+
+quint64 GLBufferBase::totalBytesUploaded()
+{
+  return glBufferBytesUploaded;
+}
+
+void GLBufferBase::resetTotalBytesUploaded()
+{
+  glBufferBytesUploaded = 0;
+}
+
+GLBufferBase::GLBufferBase(int glType, int textureFormat, QOpenGLBuffer::Type type)
+: QOpenGLBuffer(type), m_allDirty(true), m_capacity(-1), m_generation(0), m_bytesUploaded(0),
+  m_glType(glType), m_textureFormat(textureFormat), m_pooled(type == QOpenGLBuffer::VertexBuffer),
+  m_pool(nullptr), m_poolBuffer(nullptr), m_poolOffset(0)
 {
   // initializers only
 }
 
+GLBufferBase::~GLBufferBase()
+{
+  if (m_pool) {
+    m_pool->free(this);
+  }
+}
+
+bool GLBufferBase::isPooled() const
+{
+  return m_pooled;
+}
+
+void GLBufferBase::setPooled(bool on)
+{
+  if (m_pooled == on) {
+    return;
+  }
+  m_pooled = on;
+  // Move the contents to their new storage on the next bind().
+  if (m_pool) {
+    m_pool->free(this);
+  }
+  if (isCreated()) {
+    destroy();
+  }
+  m_capacity = -1;
+  markAllDirty();
+}
+
+GLuint GLBufferBase::bufferId() const
+{
+  return m_poolBuffer ? m_poolBuffer->bufferId() : QOpenGLBuffer::bufferId();
+}
+
+int GLBufferBase::storageOffset() const
+{
+  return m_poolBuffer ? m_poolOffset : 0;
+}
+
+QOpenGLBuffer* GLBufferBase::storage()
+{
+  return m_poolBuffer ? m_poolBuffer : this;
+}
+
+void GLBufferBase::markDirty(int first, int count)
+{
+  if (m_allDirty) {
+    return;
+  }
+  int last = first + count;
+  int numRanges = m_dirtyRanges.length();
+  int i = 0;
+  while (i < numRanges && m_dirtyRanges[i].second < first) {
+    i++;
+  }
+  if (i < numRanges && m_dirtyRanges[i].first <= last) {
+    // Merge with every range this one overlaps or touches.
+    QPair<int, int>& range = m_dirtyRanges[i];
+    range.first = qMin(range.first, first);
+    range.second = qMax(range.second, last);
+    while (i + 1 < m_dirtyRanges.length() && m_dirtyRanges[i + 1].first <= range.second) {
+      range.second = qMax(range.second, m_dirtyRanges[i + 1].second);
+      m_dirtyRanges.removeAt(i + 1);
+    }
+  } else {
+    m_dirtyRanges.insert(i, qMakePair(first, last));
+  }
+
+  if (m_dirtyRanges.length() > MAX_DIRTY_RANGES) {
+    QPair<int, int> bounds(m_dirtyRanges.first().first, m_dirtyRanges.last().second);
+    m_dirtyRanges.clear();
+    m_dirtyRanges << bounds;
+  }
+}
+
+void GLBufferBase::markAllDirty()
+{
+  m_allDirty = true;
+  m_dirtyRanges.clear();
+}
+
 bool GLBufferBase::bind()
 {
-  if (!isCreated()) {
+  GLBufferPool* pool = m_pooled ? GLBufferPool::instance(QOpenGLContext::currentContext()) : nullptr;
+  if (m_poolBuffer && m_pool != pool) {
+    // The storage belongs to a different share group.
+    m_pool->free(this);
+    m_capacity = -1;
+  } else if (!pool && !isCreated()) {
     create();
+    m_capacity = -1;
   }
-  bool ok = QOpenGLBuffer::bind();
-  if (ok && m_dirty) {
-    build();
-    m_dirty = false;
+
+  int size = bufferSize();
+  if (size > m_capacity) {
+    // Grow geometrically so that a buffer that keeps getting a little
+    // bigger isn't reallocated every time. Shrinking keeps the storage.
+    m_capacity = qMax(size, m_capacity * 2);
+    if (pool) {
+      if (!pool->allocate(this, m_capacity)) {
+        return false;
+      }
+    } else {
+      if (!QOpenGLBuffer::bind()) {
+        return false;
+      }
+      allocate(m_capacity);
+    }
+    m_generation++;
+    markAllDirty();
   }
-  return ok;
+  if (!storage()->bind()) {
+    return false;
+  }
+
+  int n = count();
+  if (m_allDirty) {
+    m_dirtyRanges.clear();
+    m_dirtyRanges << qMakePair(0, n);
+  }
+  for (const QPair<int, int>& range : m_dirtyRanges) {
+    int end = qMin(range.second, n);
+    if (end <= range.first) {
+      continue;
+    }
+    upload(range.first, end - range.first);
+    quint64 bytes = quint64(end - range.first) * elementSize();
+    m_bytesUploaded += bytes;
+    glBufferBytesUploaded += bytes;
+  }
+  m_dirtyRanges.clear();
+  m_allDirty = false;
+  return true;
+}
+
+void GLBufferBase::release()
+{
+  storage()->release();
 }
 
 int GLBufferBase::bufferSize() const
 {
   return count() * elementSize();
 }
+
+int GLBufferBase::capacity() const
+{
+  return qMax(m_capacity, 0);
+}
+
+quint64 GLBufferBase::bytesUploaded() const
+{
+  return m_bytesUploaded;
+}
+
+int GLBufferBase::glType() const
+{
+  return m_glType;
+}
+
+int GLBufferBase::storageGeneration() const
+{
+  return m_generation;
+}
+
+QOpenGLTexture* GLBufferBase::texture()
+{
+  if (!m_texture) {
+    m_texture.reset(new QOpenGLTexture(QOpenGLTexture::TargetBuffer));
+  }
+  if (!m_texture->isCreated()) {
+    m_texture->create();
+  }
+  return m_texture.data();
+}
@@ -2,40 +2,72 @@
 #define DL_GLBUFFER_H
 
 #include <QOpenGLBuffer>
+#include <QSharedPointer>
+#include <QPointer>
 #include <QVector>
+#include <QPair>
 #include <QVector4D>
 #include <QPolygonF>
 #include <QColor>
+#include <cstddef>
 class BoundProgram;
+class GLBufferPool;
+class QOpenGLTexture;
 
 namespace GLBufferContainer {
   template <typename T> struct Element {};
 
-#define MAP_TYPE(CppType, GlType) template <> struct Element<CppType> { enum { Type = GlType, Bytes = sizeof(CppType), Length = 1 }; }
-#define MAP_TYPE_VEC(CppType, GlType, ElementType, Count) template <> struct Element<CppType> { enum { Type = GlType, Bytes = sizeof(ElementType) * Count, Length = Count }; }
-  MAP_TYPE(GLbyte, GL_BYTE);
-  MAP_TYPE(GLubyte, GL_UNSIGNED_BYTE);
-  MAP_TYPE(GLshort, GL_SHORT);
-  MAP_TYPE(GLushort, GL_UNSIGNED_SHORT);
-  MAP_TYPE(GLint, GL_INT);
-  MAP_TYPE(GLuint, GL_UNSIGNED_INT);
-  MAP_TYPE(GLfloat, GL_FLOAT);
-  MAP_TYPE(GLdouble, GL_DOUBLE);
-  MAP_TYPE_VEC(QPointF, GL_FLOAT, GLfloat, 2);
-  MAP_TYPE_VEC(QColor, GL_FLOAT, GLfloat, 4);
-  MAP_TYPE_VEC(QVector2D, GL_FLOAT, GLfloat, 2);
-  MAP_TYPE_VEC(QVector3D, GL_FLOAT, GLfloat, 3);
-  MAP_TYPE_VEC(QVector4D, GL_FLOAT, GLfloat, 4);
+  // TextureFormat is the internal format used when the buffer is sampled
+  // as a texture buffer, or 0 if the type can't be used that way.
+#define MAP_TYPE(CppType, GlType, TexFormat) template <> struct Element<CppType> { enum { Type = GlType, Bytes = sizeof(CppType), Length = 1, TextureFormat = TexFormat }; }
+#define MAP_TYPE_VEC(CppType, GlType, ElementType, Count, TexFormat) template <> struct Element<CppType> { enum { Type = GlType, Bytes = sizeof(ElementType) * Count, Length = Count, TextureFormat = TexFormat }; }
+  MAP_TYPE(GLbyte, GL_BYTE, GL_R8I);
+  MAP_TYPE(GLubyte, GL_UNSIGNED_BYTE, GL_R8UI);
+  MAP_TYPE(GLshort, GL_SHORT, GL_R16I);
+  MAP_TYPE(GLushort, GL_UNSIGNED_SHORT, GL_R16UI);
+  MAP_TYPE(GLint, GL_INT, GL_R32I);
+  MAP_TYPE(GLuint, GL_UNSIGNED_INT, GL_R32UI);
+  MAP_TYPE(GLfloat, GL_FLOAT, GL_R32F);
+  MAP_TYPE(GLdouble, GL_DOUBLE, 0);
+  MAP_TYPE_VEC(QPointF, GL_FLOAT, GLfloat, 2, GL_RG32F);
+  MAP_TYPE_VEC(QColor, GL_FLOAT, GLfloat, 4, GL_RGBA32F);
+  MAP_TYPE_VEC(QVector2D, GL_FLOAT, GLfloat, 2, GL_RG32F);
+  MAP_TYPE_VEC(QVector3D, GL_FLOAT, GLfloat, 3, GL_RGB32F);
+  MAP_TYPE_VEC(QVector4D, GL_FLOAT, GLfloat, 4, GL_RGBA32F);
 #undef MAP_TYPE
 #undef MAP_TYPE_VEC
 
+  // An attribute fed by one member of an interleaved vertex struct
+  struct Attribute {
+    int location;
+    int type;
+    int length;
+    int offset;
+  };
+
+  // Format<T>::attributes lists the attributes fed by each element of a
+  // GLBuffer<T>, for vertex structs declared with VERTEX_FORMAT.
+  template <typename T> struct Format {};
+
+  // Vertex structs are uploaded as-is, so their members must already be
+  // stored the way GL reads them.
+  template <typename T>
+  constexpr int nativeType()
+  {
+    static_assert(Element<T>::Bytes == sizeof(T), "vertex struct members must be GL types, e.g. QVector2D instead of QPointF");
+    return Element<T>::Type;
+  }
+
+  // write() uploads elements [first, first + count) to the same place in
+  // the bound buffer, whose storage starts base bytes in, converting them to
+  // GL types if necessary.
   template <typename T>
   struct Container : public QVector<T> {
     using Type = QVector<T>;
 
-    static void allocate(QOpenGLBuffer* buffer, const Type& data, int size)
+    static void write(QOpenGLBuffer* buffer, int base, const Type& data, int first, int count)
     {
-      buffer->allocate(data.constData(), size);
+      buffer->write(base + first * sizeof(T), data.constData() + first, count * sizeof(T));
     }
   };
 
@@ -43,16 +75,15 @@ namespace GLBufferContainer {
   struct Container<QPointF> : public QPolygonF {
     using Type = QPolygonF;
 
-    static void allocate(QOpenGLBuffer* buffer, const Type& data, int size)
+    static void write(QOpenGLBuffer* buffer, int base, const Type& data, int first, int count)
     {
-      int numVertices = data.length();
-      QVector<GLfloat> vertices(2 * numVertices);
-      for (int i = 0, j = 0; i < numVertices; i++) {
-        const QPointF& point = data[i];
+      QVector<GLfloat> vertices(2 * count);
+      for (int i = 0, j = 0; i < count; i++) {
+        const QPointF& point = data[first + i];
         vertices[j++] = point.x();
         vertices[j++] = point.y();
       }
-      buffer->allocate(vertices.constData(), size);
+      buffer->write(base + first * 2 * sizeof(GLfloat), vertices.constData(), vertices.length() * sizeof(GLfloat));
     }
   };
 
@@ -60,40 +91,103 @@ namespace GLBufferContainer {
   struct Container<QColor> : public QVector<QColor> {
     using Type = QVector<QColor>;
 
-    static void allocate(QOpenGLBuffer* buffer, const Type& data, int size)
+    static void write(QOpenGLBuffer* buffer, int base, const Type& data, int first, int count)
     {
-      int numColors = data.length();
-      QVector<GLfloat> colors(4 * numColors);
-      for (int i = 0, j = 0; i < numColors; i++) {
-        const QColor& c = data[i];
+      QVector<GLfloat> colors(4 * count);
+      for (int i = 0, j = 0; i < count; i++) {
+        const QColor& c = data[first + i];
         colors[j++] = c.redF();
         colors[j++] = c.greenF();
         colors[j++] = c.blueF();
         colors[j++] = c.alphaF();
       }
-      buffer->allocate(colors.constData(), size);
+      buffer->write(base + first * 4 * sizeof(GLfloat), colors.constData(), colors.length() * sizeof(GLfloat));
     }
   };
 }
 
+// Declares the layout of an interleaved vertex struct, at global scope:
+//
+//   VERTEX_FORMAT(Vertex,
+//     VERTEX_ATTRIBUTE(Vertex, pos, 0),
+//     VERTEX_ATTRIBUTE(Vertex, color, 1))
+//
+// A GLBuffer<Vertex> can then feed all of the attributes with one
+// VertexArray::setVertexBuffer() or BoundProgram::bindVertexBuffer().
+#define VERTEX_ATTRIBUTE(Struct, member, location) \
+  GLBufferContainer::Attribute{ location, GLBufferContainer::nativeType<decltype(Struct::member)>(), \
+    GLBufferContainer::Element<decltype(Struct::member)>::Length, int(offsetof(Struct, member)) }
+#define VERTEX_FORMAT(Struct, ...) \
+  namespace GLBufferContainer { \
+    template <> struct Element<Struct> { enum { Type = GL_FLOAT, Bytes = sizeof(Struct), Length = 0, TextureFormat = 0 }; }; \
+    template <> struct Format<Struct> { static constexpr Attribute attributes[] = { __VA_ARGS__ }; }; \
+  }
+
 class GLBufferBase : public QOpenGLBuffer
 {
 public:
-  GLBufferBase(int glType, QOpenGLBuffer::Type type);
+  // Bytes sent to the GPU by all buffers since the last reset
+  static quint64 totalBytesUploaded();
+  static void resetTotalBytesUploaded();
+
+  GLBufferBase(int glType, int textureFormat, QOpenGLBuffer::Type type);
+  GLBufferBase(const GLBufferBase& other) = delete;
+  GLBufferBase& operator=(const GLBufferBase& other) = delete;
+  virtual ~GLBufferBase();
 
   virtual int count() const = 0;
   virtual int elementSize() const = 0;
   virtual int elementLength() const = 0;
   int bufferSize() const;
+  // The size of the GPU storage, which may be larger than the contents
+  int capacity() const;
+  quint64 bytesUploaded() const;
+  int glType() const;
+  // Changes whenever the GPU storage is reallocated or moved
+  int storageGeneration() const;
+
+  // Vertex buffers are suballocated from the share group's GLBufferPool
+  // unless this is turned off. Texture buffers need storage of their own,
+  // so sampling a buffer as a texture turns it off.
+  bool isPooled() const;
+  void setPooled(bool on);
+
+  // The GL buffer that holds the contents, which may be shared with other
+  // pooled buffers, and where the contents start within it, in bytes.
+  GLuint bufferId() const;
+  int storageOffset() const;
 
   bool bind();
+  void release();
+
+  // Returns a texture object that can be attached to this buffer
+  // in order to read it from a shader using a samplerBuffer.
+  QOpenGLTexture* texture();
 
 protected:
   friend class BoundProgram;
-  virtual void build() = 0;
+  friend class GLBufferPool;
+  virtual void upload(int first, int count) = 0;
+  QOpenGLBuffer* storage();
+
+  // Only the elements that changed are uploaded on the next bind().
+  void markDirty(int first, int count = 1);
+  void markAllDirty();
 
-  bool m_dirty;
+  // Sorted, non-overlapping [begin, end) element ranges
+  QVector<QPair<int, int>> m_dirtyRanges;
+  bool m_allDirty;
+  int m_capacity;
+  int m_generation;
+  quint64 m_bytesUploaded;
   int m_glType;
+  int m_textureFormat;
+  QSharedPointer<QOpenGLTexture> m_texture;
+
+  bool m_pooled;
+  QPointer<GLBufferPool> m_pool;
+  QOpenGLBuffer* m_poolBuffer;
+  int m_poolOffset;
 };
 
 template <typename T, int glType = GLBufferContainer::Element<T>::Type>
@@ -105,7 +199,7 @@ public:
   using const_iterator = typename VectorType::const_iterator;
 
   GLBuffer(const QVector<T>& data = QVector<T>(), QOpenGLBuffer::Type type = QOpenGLBuffer::VertexBuffer)
-  : GLBufferBase(glType, type), m_data(data)
+  : GLBufferBase(glType, GLBufferContainer::Element<T>::TextureFormat, type), m_data(data)
   {
     // initializers only
   }
@@ -121,11 +215,18 @@ public:
 
   const VectorType& vector() const { return m_data; };
 
-  void resize(int count) { m_data.resize(count); }
+  void resize(int count)
+  {
+    int oldCount = m_data.length();
+    m_data.resize(count);
+    if (count > oldCount) {
+      markDirty(oldCount, count - oldCount);
+    }
+  }
 
   T& operator[](int pos)
   {
-    m_dirty = true;
+    markDirty(pos);
     return m_data[pos];
   }
 
@@ -136,22 +237,38 @@ public:
 
   GLBuffer<T>& operator=(const QVector<T>& other)
   {
-    m_dirty = true;
+    int n = other.length();
+    if (n != m_data.length()) {
+      markAllDirty();
+    } else {
+      // Replacing the contents often changes only a few elements.
+      int first = 0;
+      while (first < n && m_data[first] == other[first]) {
+        first++;
+      }
+      int last = n;
+      while (last > first && m_data[last - 1] == other[last - 1]) {
+        last--;
+      }
+      if (last > first) {
+        markDirty(first, last - first);
+      }
+    }
     m_data = other;
     return *this;
   }
 
   GLBuffer<T>& operator=(std::initializer_list<T> args)
   {
-    m_dirty = true;
+    markAllDirty();
     m_data = args;
     return *this;
   }
 
 protected:
-  void build() override
+  void upload(int first, int count) override
   {
-    GLBufferContainer::Container<T>::allocate(this, m_data, bufferSize());
+    GLBufferContainer::Container<T>::write(storage(), storageOffset(), m_data, first, count);
   }
 
 private:
@@ -0,0 +1,276 @@
+#include "glbufferpool.h"
+#include "glbuffer.h"
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QtDebug>
+
+// The pools aren't QObjects that findChild() can tell apart from the group's
+// other children, so they're looked up here instead.
+static QHash<QOpenGLContextGroup*, GLBufferPool*> pools;
+
+static int alignedSize(int size)
+{
+  return qMax(GLBufferPool::ALIGNMENT, (size + GLBufferPool::ALIGNMENT - 1) & ~(GLBufferPool::ALIGNMENT - 1));
+}
+
+double GLBufferPool::Stats::occupancy() const
+{
+  return arenaBytes ? double(usedBytes) / arenaBytes : 0;
+}
+
+double GLBufferPool::Stats::fragmentation() const
+{
+  return freeBytes ? 1.0 - double(largestFreeBlock) / freeBytes : 0;
+}
+
+int GLBufferPool::Arena::freeBytes() const
+{
+  int total = 0;
+  for (int size : freeBlocks) {
+    total += size;
+  }
+  return total;
+}
+
+int GLBufferPool::Arena::largestFreeBlock() const
+{
+  int largest = 0;
+  for (int size : freeBlocks) {
+    largest = qMax(largest, size);
+  }
+  return largest;
+}
+
+GLBufferPool* GLBufferPool::instance(QOpenGLContext* ctx)
+{
+  if (!ctx) {
+    return nullptr;
+  }
+  QOpenGLContextGroup* group = ctx->shareGroup();
+  GLBufferPool* pool = pools.value(group);
+  if (!pool) {
+    pool = new GLBufferPool(group);
+    pools[group] = pool;
+  }
+  return pool;
+}
+
+GLBufferPool::GLBufferPool(QObject* group)
+: QObject(group)
+{
+  // initializers only
+}
+
+GLBufferPool::~GLBufferPool()
+{
+  pools.remove(static_cast<QOpenGLContextGroup*>(parent()));
+
+  // The share group is going away, so the buffers' contents are lost.
+  for (auto iter = m_owners.begin(); iter != m_owners.end(); iter++) {
+    GLBufferBase* owner = iter.key();
+    owner->m_poolBuffer = nullptr;
+    owner->m_capacity = -1;
+    owner->markAllDirty();
+  }
+  for (Arena* arena : m_arenas) {
+    delete arena->buffer;
+    delete arena;
+  }
+}
+
+GLBufferPool::Arena* GLBufferPool::createArena(int size)
+{
+  QOpenGLBuffer* buffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  if (!buffer->create() || !buffer->bind()) {
+    qDebug() << "unable to create buffer arena";
+    delete buffer;
+    return nullptr;
+  }
+  buffer->allocate(size);
+  buffer->release();
+
+  Arena* arena = new Arena{ buffer, size, QMap<int, Block>(), QMap<int, int>() };
+  arena->freeBlocks[0] = size;
+  m_arenas << arena;
+  return arena;
+}
+
+// Carves size bytes out of the arena's first free block that can hold
+// them. Returns the offset, or -1 if there's no such block.
+int GLBufferPool::take(Arena* arena, int size)
+{
+  for (auto iter = arena->freeBlocks.begin(); iter != arena->freeBlocks.end(); iter++) {
+    if (iter.value() >= size) {
+      int offset = iter.key();
+      int remaining = iter.value() - size;
+      arena->freeBlocks.erase(iter);
+      if (remaining) {
+        arena->freeBlocks[offset + size] = remaining;
+      }
+      return offset;
+    }
+  }
+  return -1;
+}
+
+void GLBufferPool::assign(Arena* arena, int offset, GLBufferBase* buffer, int size)
+{
+  arena->used[offset] = Block{ buffer, size };
+  m_owners[buffer] = arena;
+  buffer->m_pool = this;
+  buffer->m_poolBuffer = arena->buffer;
+  buffer->m_poolOffset = offset;
+}
+
+bool GLBufferPool::allocate(GLBufferBase* buffer, int size)
+{
+  free(buffer);
+  releaseEmptyArenas();
+  size = alignedSize(size);
+
+  for (Arena* arena : m_arenas) {
+    int offset = take(arena, size);
+    if (offset >= 0) {
+      assign(arena, offset, buffer, size);
+      return true;
+    }
+  }
+
+  // Compacting an arena is cheaper than making a new one.
+  for (Arena* arena : m_arenas) {
+    if (arena->freeBytes() >= size) {
+      compact(arena);
+      int offset = take(arena, size);
+      if (offset >= 0) {
+        assign(arena, offset, buffer, size);
+        return true;
+      }
+    }
+  }
+
+  Arena* arena = createArena(qMax(int(ARENA_SIZE), size));
+  if (!arena) {
+    return false;
+  }
+  assign(arena, take(arena, size), buffer, size);
+  return true;
+}
+
+void GLBufferPool::free(GLBufferBase* buffer)
+{
+  Arena* arena = m_owners.take(buffer);
+  if (!arena) {
+    return;
+  }
+  buffer->m_poolBuffer = nullptr;
+  buffer->m_pool = nullptr;
+
+  int offset = buffer->m_poolOffset;
+  int size = arena->used.take(offset).size;
+
+  // Merge with the free blocks on either side.
+  auto next = arena->freeBlocks.lowerBound(offset);
+  if (next != arena->freeBlocks.end() && next.key() == offset + size) {
+    size += next.value();
+    next = arena->freeBlocks.erase(next);
+  }
+  if (next != arena->freeBlocks.begin()) {
+    auto prev = next - 1;
+    if (prev.key() + prev.value() == offset) {
+      offset = prev.key();
+      size += prev.value();
+    }
+  }
+  arena->freeBlocks[offset] = size;
+}
+
+// Deletes the arenas that have nothing in them, keeping one around. This has
+// to wait for a context in the pool's share group.
+void GLBufferPool::releaseEmptyArenas()
+{
+  QOpenGLContext* ctx = QOpenGLContext::currentContext();
+  if (!ctx || ctx->shareGroup() != parent()) {
+    return;
+  }
+  for (int i = m_arenas.length() - 1; i >= 0 && m_arenas.length() > 1; i--) {
+    Arena* arena = m_arenas[i];
+    if (arena->used.isEmpty()) {
+      m_arenas.removeAt(i);
+      delete arena->buffer;
+      delete arena;
+    }
+  }
+}
+
+// Moves everything in the arena to the front of a new buffer. The data is
+// copied on the GPU; the buffers that moved are told to respecify their
+// attribute pointers.
+void GLBufferPool::compact(Arena* arena)
+{
+  QOpenGLContext* ctx = QOpenGLContext::currentContext();
+  if (!ctx || ctx->shareGroup() != parent()) {
+    qWarning("GLBufferPool::compact called without a context in the pool's share group");
+    return;
+  }
+  QOpenGLExtraFunctions* f = ctx->extraFunctions();
+
+  QOpenGLBuffer* moved = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  if (!moved->create() || !moved->bind()) {
+    qDebug() << "unable to create buffer arena";
+    delete moved;
+    return;
+  }
+  moved->allocate(arena->size);
+  moved->release();
+
+  f->glBindBuffer(GL_COPY_READ_BUFFER, arena->buffer->bufferId());
+  f->glBindBuffer(GL_COPY_WRITE_BUFFER, moved->bufferId());
+  QMap<int, Block> used;
+  int offset = 0;
+  for (auto iter = arena->used.begin(); iter != arena->used.end(); iter++) {
+    const Block& block = iter.value();
+    f->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, iter.key(), offset, block.size);
+    block.owner->m_poolBuffer = moved;
+    block.owner->m_poolOffset = offset;
+    block.owner->m_generation++;
+    used[offset] = block;
+    offset += block.size;
+  }
+  f->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  delete arena->buffer;
+  arena->buffer = moved;
+  arena->used = used;
+  arena->freeBlocks.clear();
+  if (offset < arena->size) {
+    arena->freeBlocks[offset] = arena->size - offset;
+  }
+}
+
+void GLBufferPool::defragment()
+{
+  releaseEmptyArenas();
+  for (Arena* arena : m_arenas) {
+    if (arena->freeBlocks.size() > 1) {
+      compact(arena);
+    }
+  }
+}
+
+GLBufferPool::Stats GLBufferPool::stats() const
+{
+  Stats stats;
+  stats.arenas = m_arenas.length();
+  for (const Arena* arena : m_arenas) {
+    stats.allocations += arena->used.size();
+    stats.freeBlocks += arena->freeBlocks.size();
+    stats.arenaBytes += arena->size;
+    for (const Block& block : arena->used) {
+      stats.usedBytes += block.size;
+    }
+    stats.freeBytes += arena->freeBytes();
+    stats.largestFreeBlock = qMax(stats.largestFreeBlock, qint64(arena->largestFreeBlock()));
+  }
+  return stats;
+}
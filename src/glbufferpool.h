@@ -0,0 +1,89 @@
+#ifndef DL_GLBUFFERPOOL_H
+#define DL_GLBUFFERPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QMap>
+#include <QHash>
+class QOpenGLContext;
+class QOpenGLBuffer;
+class GLBufferBase;
+
+// GLBufferPool suballocates vertex buffers from a few large arenas so that
+// a document with many meshes doesn't need a GL buffer object for every
+// attribute of every mesh. Each buffer gets an aligned block in an arena;
+// freed blocks are coalesced and reused first-fit. When no block is big
+// enough but an arena has the space in pieces, that arena is compacted.
+//
+// There is one pool per context share group, owned by the group.
+class GLBufferPool : public QObject
+{
+public:
+  struct Stats
+  {
+    int arenas = 0;
+    int allocations = 0;
+    int freeBlocks = 0;
+    qint64 arenaBytes = 0;
+    qint64 usedBytes = 0;
+    qint64 freeBytes = 0;
+    qint64 largestFreeBlock = 0;
+
+    // The fraction of the arenas in use
+    double occupancy() const;
+    // 0 when all of the free space is in one block, approaching 1 as it
+    // gets split into smaller pieces
+    double fragmentation() const;
+  };
+
+  static const int ARENA_SIZE = 4 << 20;
+  static const int ALIGNMENT = 16;
+
+  static GLBufferPool* instance(QOpenGLContext* ctx);
+
+  ~GLBufferPool();
+
+  // Gives buffer a block of at least size bytes, releasing the one it had.
+  // The current context must be in this pool's share group.
+  bool allocate(GLBufferBase* buffer, int size);
+  // Returns the buffer's block to the free list. This makes no GL calls, so
+  // it's safe without a current context; arenas left empty are released by
+  // the next allocate() or defragment().
+  void free(GLBufferBase* buffer);
+
+  // Compacts every arena whose free space is fragmented and releases empty
+  // ones. Buffers that move keep their contents.
+  void defragment();
+
+  Stats stats() const;
+
+private:
+  struct Block {
+    GLBufferBase* owner;
+    int size;
+  };
+
+  struct Arena {
+    QOpenGLBuffer* buffer;
+    int size;
+    // Keyed by offset
+    QMap<int, Block> used;
+    QMap<int, int> freeBlocks;
+
+    int freeBytes() const;
+    int largestFreeBlock() const;
+  };
+
+  GLBufferPool(QObject* group);
+
+  Arena* createArena(int size);
+  int take(Arena* arena, int size);
+  void compact(Arena* arena);
+  void releaseEmptyArenas();
+  void assign(Arena* arena, int offset, GLBufferBase* buffer, int size);
+
+  QList<Arena*> m_arenas;
+  QHash<GLBufferBase*, Arena*> m_owners;
+};
+
+#endif
@@ -1,10 +1,17 @@
 #include "glfunctions.h"
 #include <QOpenGLWidget>
 #include <QOpenGLContext>
+#include <QHash>
 #include <QOpenGLShaderProgram>
 #include <QOffscreenSurface>
 #include <QWindow>
 #include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QCoreApplication>
 #include <QtDebug>
 
 static QMap<QOpenGLContext*, GLFunctions*> ctxMap;
@@ -18,14 +25,60 @@ GLFunctions* GLFunctions::instance(QOpenGLContext* ctx)
   return ctxMap.value(ctx);
 }
 
-GLFunctions::GLFunctions(QObject* surface)
-: QOpenGLFunctions(), m_surface(nullptr), m_widget(nullptr), m_ctx(nullptr)
+// Linked programs can be used by any context in a share group, so they're
+// kept for as long as the group is rather than by each GLFunctions. The
+// caches aren't QObjects that findChild() can tell apart from the group's
+// other children, so they're looked up in programCaches instead.
+class ProgramCache;
+static QHash<QOpenGLContextGroup*, ProgramCache*> programCaches;
+
+class ProgramCache : public QObject
+{
+public:
+  static ProgramCache* instance(QOpenGLContext* ctx)
+  {
+    QOpenGLContextGroup* group = ctx->shareGroup();
+    ProgramCache* cache = programCaches.value(group);
+    if (!cache) {
+      cache = new ProgramCache(group);
+      programCaches[group] = cache;
+    }
+    return cache;
+  }
+
+  ~ProgramCache()
+  {
+    programCaches.remove(group);
+    qDeleteAll(programs);
+  }
+
+  QMap<QString, QOpenGLShaderProgram*> programs;
+
+private:
+  ProgramCache(QOpenGLContextGroup* group)
+  : QObject(group), group(group)
+  {
+    // initializers only
+  }
+
+  QOpenGLContextGroup* group;
+};
+
+QSurfaceFormat GLFunctions::defaultFormat(int samples)
 {
   QSurfaceFormat format;
   format.setRenderableType(QSurfaceFormat::OpenGL);
   format.setProfile(QSurfaceFormat::CoreProfile);
   format.setVersion(4, 1);
-  format.setSamples(16);
+  format.setSamples(samples);
+  return format;
+}
+
+GLFunctions::GLFunctions(QObject* surface, int samples)
+: QOpenGLFunctions_4_1_Core(), m_programs(nullptr), m_surface(nullptr), m_widget(nullptr), m_ctx(nullptr),
+  m_evaluatorTier(ReferenceEvaluator), m_analyticAntialiasing(true), m_profiler(nullptr)
+{
+  QSurfaceFormat format = defaultFormat(samples);
 
   if (QOpenGLWidget* widget = dynamic_cast<QOpenGLWidget*>(surface)) {
     widget->setFormat(format);
@@ -44,7 +97,6 @@ GLFunctions::~GLFunctions()
   activateGL();
   m_vao.destroy();
   ctxMap.remove(m_ctx);
-  qDeleteAll(m_shaders);
 }
 
 void GLFunctions::activateGL()
@@ -60,7 +112,10 @@ void GLFunctions::initialize(QOpenGLContext* ctx)
 {
   m_ctx = ctx;
   ctxMap[m_ctx] = this;
-  initializeOpenGLFunctions();
+  if (!initializeOpenGLFunctions()) {
+    qFatal("OpenGL 4.1 core profile is not available");
+  }
+  m_programs = ProgramCache::instance(ctx);
 
   m_vao.create();
 }
@@ -75,39 +130,242 @@ void GLFunctions::setTransform(const QTransform& transform)
   m_transform = transform;
 }
 
-BoundProgram GLFunctions::useShader(const QString& name, int n)
+GLFunctions::EvaluatorTier GLFunctions::evaluatorTier() const
+{
+  return m_evaluatorTier;
+}
+
+void GLFunctions::setEvaluatorTier(EvaluatorTier tier)
+{
+  m_evaluatorTier = tier;
+}
+
+QStringList GLFunctions::evaluatorDefines() const
+{
+  if (m_evaluatorTier == FastEvaluator) {
+    return QStringList{ "FAST_EVALUATOR" };
+  }
+  return QStringList();
+}
+
+bool GLFunctions::analyticAntialiasing() const
+{
+  return m_analyticAntialiasing;
+}
+
+void GLFunctions::setAnalyticAntialiasing(bool on)
+{
+  m_analyticAntialiasing = on;
+}
+
+QStringList GLFunctions::meshDefines() const
+{
+  QStringList defines = evaluatorDefines();
+  if (m_analyticAntialiasing) {
+    defines << "ANALYTIC_AA";
+  }
+  return defines;
+}
+
+GPUProfiler* GLFunctions::profiler() const
+{
+  return m_profiler;
+}
+
+void GLFunctions::setProfiler(GPUProfiler* profiler)
+{
+  m_profiler = profiler;
+}
+
+// Maps a rectangle in scene coordinates to window coordinates
+// using the current transform, clipped to the viewport.
+QRect GLFunctions::deviceRect(const QRectF& sceneRect)
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  QRectF ndc = transform().mapRect(sceneRect);
+  QRectF window(
+    viewport[0] + (ndc.left() + 1) * viewport[2] / 2,
+    viewport[1] + (ndc.top() + 1) * viewport[3] / 2,
+    ndc.width() * viewport[2] / 2,
+    ndc.height() * viewport[3] / 2
+  );
+  return window.toAlignedRect().intersected(QRect(viewport[0], viewport[1], viewport[2], viewport[3]));
+}
+
+// Returns the area of the scene that the current transform maps onto
+// the viewport.
+QRectF GLFunctions::visibleSceneRect() const
+{
+  bool invertible = false;
+  QTransform inverse = transform().inverted(&invertible);
+  if (!invertible) {
+    return QRectF();
+  }
+  return inverse.mapRect(QRectF(-1, -1, 2, 2));
+}
+
+// Clears the stencil buffer only in the area covered by sceneRect,
+// respecting any scissor rectangle that is already active.
+void GLFunctions::clearStencil(const QRectF& sceneRect)
+{
+  QRect rect = deviceRect(sceneRect);
+  GLboolean hadScissor = glIsEnabled(GL_SCISSOR_TEST);
+  GLint oldBox[4];
+  glGetIntegerv(GL_SCISSOR_BOX, oldBox);
+  if (hadScissor) {
+    rect &= QRect(oldBox[0], oldBox[1], oldBox[2], oldBox[3]);
+  }
+  if (rect.isEmpty()) {
+    return;
+  }
+
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(rect.x(), rect.y(), rect.width(), rect.height());
+  glStencilMask(0xFF);
+  glClear(GL_STENCIL_BUFFER_BIT);
+
+  glScissor(oldBox[0], oldBox[1], oldBox[2], oldBox[3]);
+  if (!hadScissor) {
+    glDisable(GL_SCISSOR_TEST);
+  }
+}
+
+BoundProgram GLFunctions::useShader(const QString& name, const QStringList& defines)
 {
-  QString templatedName = name;
-  if (n) {
-    templatedName = QStringLiteral("%1_%2").arg(name).arg(n);
+  // Variants are keyed by feature flags, never by document content,
+  // so the number of programs per share group stays small and fixed.
+  QStringList sortedDefines = defines;
+  sortedDefines.sort();
+  QString variantName = name;
+  if (!sortedDefines.isEmpty()) {
+    variantName = QStringLiteral("%1[%2]").arg(name).arg(sortedDefines.join(","));
   }
-  QOpenGLShaderProgram* program = m_shaders.value(templatedName);
+  QOpenGLShaderProgram* program = m_programs->programs.value(variantName);
   if (!program) {
-    program = new QOpenGLShaderProgram();
-    m_shaders[templatedName] = program;
-    addShader(program, name, n, QOpenGLShader::Fragment);
-    addShader(program, name, n, QOpenGLShader::Vertex);
-    bool ok = program->link();
-    if (!ok) {
-      qFatal(qPrintable(QStringLiteral("Shader linking failed in %1:\n%2").arg(templatedName).arg(program->log())));
-    }
+    program = buildProgram(name, sortedDefines);
+    m_programs->programs[variantName] = program;
   }
   return BoundProgram(this, program, &m_vao);
 }
 
-void GLFunctions::addShader(QOpenGLShaderProgram* program, const QString& name, int n, QOpenGLShader::ShaderType type)
+QOpenGLShaderProgram* GLFunctions::buildProgram(const QString& name, const QStringList& defines)
+{
+  QString fragment = shaderSource(name, defines, QOpenGLShader::Fragment);
+  QString vertex = shaderSource(name, defines, QOpenGLShader::Vertex);
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(fragment.toUtf8());
+  hash.addData(vertex.toUtf8());
+  for (GLenum param : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+    hash.addData(QByteArray(reinterpret_cast<const char*>(glGetString(param))));
+  }
+  QString cachePath = shaderCachePath(hash.result().toHex());
+
+  QOpenGLShaderProgram* program = loadProgramBinary(cachePath);
+  if (program) {
+    return program;
+  }
+
+  program = new QOpenGLShaderProgram();
+
+  bool ok = program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragment);
+  if (ok) {
+    ok = program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex);
+  }
+  if (!ok) {
+    qFatal(qPrintable(QStringLiteral("Shader compilation failed in %1:\n%2").arg(name).arg(program->log())));
+  }
+  if (!cachePath.isEmpty()) {
+    glProgramParameteri(program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  ok = program->link();
+  if (!ok) {
+    qFatal(qPrintable(QStringLiteral("Shader linking failed in %1:\n%2").arg(name).arg(program->log())));
+  }
+  saveProgramBinary(program, cachePath);
+  return program;
+}
+
+QString GLFunctions::shaderSource(const QString& name, const QStringList& defines, QOpenGLShader::ShaderType type)
 {
   QString filename = QStringLiteral(":/shaders/%1.%2.glsl").arg(name).arg(shaderTypeNames.value(type));
   QFile file(filename);
-  bool ok = false;
-  if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-    QString source = QString::fromUtf8(file.readAll());
-    if (n) {
-      source = source.replace("<N>", QString::number(n));
-    }
-    ok = program->addShaderFromSourceCode(type, source);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    qFatal(qPrintable(QStringLiteral("Shader source not found: %1").arg(filename)));
   }
-  if (!ok) {
-    qFatal(qPrintable(QStringLiteral("Shader compilation failed in %1:\n%2").arg(filename).arg(program->log())));
+  QString source = QString::fromUtf8(file.readAll());
+
+  // #defines have to come after the #version line.
+  int insertPos = source.indexOf('\n') + 1;
+  for (const QString& define : defines) {
+    source.insert(insertPos, QStringLiteral("#define %1\n").arg(define));
+  }
+  return source;
+}
+
+QString GLFunctions::shaderCachePath(const QByteArray& key)
+{
+  if (QCoreApplication::testAttribute(Qt::AA_DisableShaderDiskCache)) {
+    return QString();
+  }
+  QDir dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+  if (!dir.mkpath("shaders")) {
+    return QString();
+  }
+  return dir.filePath(QStringLiteral("shaders/%1.bin").arg(QString::fromLatin1(key)));
+}
+
+QOpenGLShaderProgram* GLFunctions::loadProgramBinary(const QString& path)
+{
+  if (path.isEmpty()) {
+    return nullptr;
+  }
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return nullptr;
+  }
+  QDataStream stream(&file);
+  quint32 format;
+  QByteArray binary;
+  stream >> format >> binary;
+  if (stream.status() != QDataStream::Ok || binary.isEmpty()) {
+    return nullptr;
+  }
+
+  QOpenGLShaderProgram* program = new QOpenGLShaderProgram();
+  program->create();
+  glProgramBinary(program->programId(), format, binary.constData(), binary.size());
+  // With no shaders attached, QOpenGLShaderProgram picks up the existing
+  // link status. If the driver rejected the binary (for example, because
+  // it was updated) the caller will compile the program from source.
+  if (!program->link()) {
+    delete program;
+    return nullptr;
+  }
+  return program;
+}
+
+void GLFunctions::saveProgramBinary(QOpenGLShaderProgram* program, const QString& path)
+{
+  if (path.isEmpty()) {
+    return;
+  }
+  GLint length = 0;
+  glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  QByteArray binary(length, '\0');
+  GLenum format = 0;
+  glGetProgramBinary(program->programId(), length, &length, &format, binary.data());
+  binary.resize(length);
+
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    return;
   }
+  QDataStream stream(&file);
+  stream << quint32(format) << binary;
+  file.commit();
 }
@@ -1,40 +1,83 @@
 #ifndef DL_GLFUNCTIONS_H
 #define DL_GLFUNCTIONS_H
 
-#include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_1_Core>
+#include <QSurfaceFormat>
 #include <QOpenGLVertexArrayObject>
 #include <QMap>
 #include <QString>
+#include <QStringList>
 #include <QTransform>
 #include "boundprogram.h"
 class QOpenGLContext;
 class QOpenGLWidget;
+class GPUProfiler;
+class ProgramCache;
 
-class GLFunctions : public QOpenGLFunctions
+class GLFunctions : public QOpenGLFunctions_4_1_Core
 {
 public:
+  // The kernels available for evaluating mesh gradients.
+  // Reference is the most accurate; Fast is cheaper for interactive use.
+  enum EvaluatorTier {
+    ReferenceEvaluator,
+    FastEvaluator,
+  };
+
   static GLFunctions* instance(QOpenGLContext* ctx);
+  // With analytic antialiasing, multisampling is only needed for the
+  // cosmetic overlays, so a few samples are enough.
+  static const int DEFAULT_SAMPLES = 4;
+  static QSurfaceFormat defaultFormat(int samples = DEFAULT_SAMPLES);
 
-  GLFunctions(QObject* surface);
+  GLFunctions(QObject* surface, int samples = DEFAULT_SAMPLES);
   virtual ~GLFunctions();
 
-  BoundProgram useShader(const QString& name, int n = 0);
+  BoundProgram useShader(const QString& name, const QStringList& defines = QStringList());
 
   virtual QTransform transform() const;
   void setTransform(const QTransform& transform);
 
+  EvaluatorTier evaluatorTier() const;
+  void setEvaluatorTier(EvaluatorTier tier);
+  QStringList evaluatorDefines() const;
+
+  // Fades mesh boundaries in the shader instead of relying on multisampling.
+  bool analyticAntialiasing() const;
+  void setAnalyticAntialiasing(bool on);
+  // The defines for the shaders that evaluate mesh gradients
+  QStringList meshDefines() const;
+
+  // The profiler that rendering code reports GPU timings to, if any
+  GPUProfiler* profiler() const;
+  void setProfiler(GPUProfiler* profiler);
+
+  QRect deviceRect(const QRectF& sceneRect);
+  QRectF visibleSceneRect() const;
+  void clearStencil(const QRectF& sceneRect);
+
   void initialize(QOpenGLContext* ctx);
 
 private:
   void activateGL();
-  void addShader(QOpenGLShaderProgram* program, const QString& name, int n, QOpenGLShader::ShaderType type);
+  QOpenGLShaderProgram* buildProgram(const QString& name, const QStringList& defines);
+  QString shaderSource(const QString& name, const QStringList& defines, QOpenGLShader::ShaderType type);
+
+  // Linked programs are cached on disk, keyed by their source and the driver.
+  QString shaderCachePath(const QByteArray& key);
+  QOpenGLShaderProgram* loadProgramBinary(const QString& path);
+  void saveProgramBinary(QOpenGLShaderProgram* program, const QString& path);
 
-  QMap<QString, QOpenGLShaderProgram*> m_shaders;
+  // Shared by every context in the share group
+  ProgramCache* m_programs;
   QOpenGLVertexArrayObject m_vao;
   QSurface* m_surface;
   QOpenGLWidget* m_widget;
   QOpenGLContext* m_ctx;
   QTransform m_transform;
+  EvaluatorTier m_evaluatorTier;
+  bool m_analyticAntialiasing;
+  GPUProfiler* m_profiler;
 };
 
 #endif
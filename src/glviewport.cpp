@@ -3,6 +3,14 @@
 #include <QWindow>
 #include <QGraphicsView>
 #include <QGraphicsItem>
+#include <QOpenGLFramebufferObject>
+#include <cmath>
+
+// Limits for the dynamic resolution scale
+static const double MIN_SCALE = 0.25;
+static const double MAX_SCALE = 1.0;
+// How long input has to be idle before rendering at full quality again
+static const int IDLE_MSECS = 250;
 
 GLViewport* GLViewport::instance(QOpenGLContext* ctx)
 {
@@ -10,9 +18,24 @@ GLViewport* GLViewport::instance(QOpenGLContext* ctx)
 }
 
 GLViewport::GLViewport(QWidget* parent)
-: QOpenGLWidget(parent), GLFunctions(this)
+: QOpenGLWidget(parent), GLFunctions(this), m_dynamicResolution(false), m_interacting(false),
+  m_frameBudget(8.0), m_interactiveScale(MAX_SCALE), m_frameOpen(false)
 {
-  // initializers only
+  // Keep the previous frame so that QGraphicsView can repaint only the
+  // regions that changed.
+  setUpdateBehavior(QOpenGLWidget::PartialUpdate);
+
+  m_idleTimer.setSingleShot(true);
+  m_idleTimer.setInterval(IDLE_MSECS);
+  QObject::connect(&m_idleTimer, SIGNAL(timeout()), this, SLOT(interactionIdle()));
+
+  QPolygonF quad;
+  quad << QPointF(-1, -1) << QPointF(1, -1) << QPointF(1, 1);
+  quad << QPointF(-1, -1) << QPointF(1, 1) << QPointF(-1, 1);
+  m_layerQuad = quad;
+  m_layerArray.setAttributeBuffer(0, &m_layerQuad);
+
+  setProfiler(&m_profiler);
 }
 
 GLViewport::~GLViewport()
@@ -22,6 +45,10 @@ GLViewport::~GLViewport()
   if (view) {
     qDeleteAll(view->items());
   }
+  m_profiler.finish();
+  m_layer.reset();
+  m_layerArray.clear();
+  m_layerQuad.destroy();
 }
 
 QTransform GLViewport::transform() const
@@ -43,7 +70,215 @@ EditorView* GLViewport::editor() const
   return dynamic_cast<EditorView*>(parent());
 }
 
+int GLViewport::sampleCount() const
+{
+  return format().samples();
+}
+
+void GLViewport::setSampleCount(int samples)
+{
+  setFormat(defaultFormat(samples));
+}
+
 void GLViewport::initializeGL()
 {
   initialize(context());
 }
+
+bool GLViewport::dynamicResolution() const
+{
+  return m_dynamicResolution;
+}
+
+void GLViewport::setDynamicResolution(bool on)
+{
+  m_dynamicResolution = on;
+  if (!on) {
+    interactionIdle();
+  }
+}
+
+double GLViewport::frameBudget() const
+{
+  return m_frameBudget;
+}
+
+void GLViewport::setFrameBudget(double msecs)
+{
+  m_frameBudget = msecs;
+}
+
+double GLViewport::renderScale() const
+{
+  if (m_dynamicResolution && m_interacting) {
+    return m_interactiveScale;
+  }
+  return MAX_SCALE;
+}
+
+void GLViewport::markInteraction()
+{
+  if (!m_dynamicResolution) {
+    return;
+  }
+  m_interacting = true;
+  m_idleTimer.start();
+}
+
+void GLViewport::interactionIdle()
+{
+  m_idleTimer.stop();
+  if (!m_interacting) {
+    return;
+  }
+  m_interacting = false;
+  // Parts of the view may have been drawn at a lower resolution.
+  update();
+}
+
+GPUProfiler* GLViewport::frameProfiler()
+{
+  return &m_profiler;
+}
+
+void GLViewport::beginFrame()
+{
+  if ((!m_dynamicResolution && !m_profiler.isEnabled(GPUProfiler::PerMesh)) || !isValid()) {
+    return;
+  }
+  makeCurrent();
+  m_profiler.beginFrame();
+  adjustScale();
+  m_frameScales[m_profiler.currentFrame()] = renderScale();
+  m_profiler.begin(this);
+  m_frameOpen = true;
+}
+
+void GLViewport::endFrame()
+{
+  if (!m_frameOpen) {
+    return;
+  }
+  makeCurrent();
+  m_profiler.end();
+  m_frameOpen = false;
+}
+
+void GLViewport::adjustScale()
+{
+  quint64 completed = m_profiler.completedFrame();
+  GPUTiming frame = m_profiler.timing(this);
+  if (frame.frames && frame.lastFrame <= completed && m_frameScales.contains(frame.lastFrame) && frame.lastMsecs > 0) {
+    // The cost of a frame is dominated by the number of pixels shaded,
+    // which is proportional to the square of the scale.
+    double target = m_frameScales[frame.lastFrame] * std::sqrt(m_frameBudget / frame.lastMsecs);
+    // Move halfway there to avoid oscillating.
+    m_interactiveScale = qBound(MIN_SCALE, (m_interactiveScale + target) / 2, MAX_SCALE);
+  }
+  // Each frame only needs to be considered once.
+  while (!m_frameScales.isEmpty() && m_frameScales.firstKey() <= completed) {
+    m_frameScales.erase(m_frameScales.begin());
+  }
+}
+
+bool GLViewport::beginScaledLayer(const QRectF& sceneRect)
+{
+  double scale = renderScale();
+  if (scale >= MAX_SCALE) {
+    return false;
+  }
+
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_savedFramebuffer);
+  glGetIntegerv(GL_VIEWPORT, m_savedViewport);
+  m_layerRect = deviceRect(sceneRect);
+  if (m_layerRect.isEmpty()) {
+    return false;
+  }
+  m_savedScissor = glIsEnabled(GL_SCISSOR_TEST);
+  glGetIntegerv(GL_SCISSOR_BOX, m_savedScissorBox);
+
+  QSize size(std::ceil(m_savedViewport[2] * scale), std::ceil(m_savedViewport[3] * scale));
+  if (!m_layer || m_layer->size() != size) {
+    m_layer.reset(new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::CombinedDepthStencil, GL_TEXTURE_2D, GL_RGBA8));
+    glBindTexture(GL_TEXTURE_2D, m_layer->texture());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_layer->handle());
+  glViewport(0, 0, m_savedViewport[2] * scale, m_savedViewport[3] * scale);
+
+  // Only the area being drawn needs to be cleared. The rest of the
+  // layer is never composited.
+  GLfloat oldClearColor[4];
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, oldClearColor);
+  QRect clip = deviceRect(sceneRect).adjusted(-1, -1, 1, 1);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(clip.x(), clip.y(), clip.width(), clip.height());
+  glClearColor(0, 0, 0, 0);
+  glStencilMask(0xFF);
+  glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  glClearColor(oldClearColor[0], oldClearColor[1], oldClearColor[2], oldClearColor[3]);
+
+  // QPainter's scissor box is in window coordinates. Items clip against it,
+  // so carry it over into the layer's pixels, rounded outward.
+  if (m_savedScissor) {
+    QRect box = QRectF(
+      (m_savedScissorBox[0] - m_savedViewport[0]) * scale, (m_savedScissorBox[1] - m_savedViewport[1]) * scale,
+      m_savedScissorBox[2] * scale, m_savedScissorBox[3] * scale
+    ).toAlignedRect();
+    glScissor(box.x(), box.y(), box.width(), box.height());
+  } else {
+    glDisable(GL_SCISSOR_TEST);
+  }
+
+  // Accumulate premultiplied colors so that the layer can be composited
+  // as if it had been drawn directly.
+  glGetIntegerv(GL_BLEND_SRC_RGB, &m_savedBlend[0]);
+  glGetIntegerv(GL_BLEND_DST_RGB, &m_savedBlend[1]);
+  glGetIntegerv(GL_BLEND_SRC_ALPHA, &m_savedBlend[2]);
+  glGetIntegerv(GL_BLEND_DST_ALPHA, &m_savedBlend[3]);
+  glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  return true;
+}
+
+void GLViewport::endScaledLayer()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, m_savedFramebuffer);
+  glViewport(m_savedViewport[0], m_savedViewport[1], m_savedViewport[2], m_savedViewport[3]);
+
+  GLboolean hadBlend = glIsEnabled(GL_BLEND);
+  QRect clip = m_layerRect;
+  if (m_savedScissor) {
+    clip &= QRect(m_savedScissorBox[0], m_savedScissorBox[1], m_savedScissorBox[2], m_savedScissorBox[3]);
+  }
+
+  if (!clip.isEmpty()) {
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(clip.x(), clip.y(), clip.width(), clip.height());
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    // The layer is rounded up to whole pixels, so it may be slightly
+    // larger than the scaled viewport.
+    QSize size = m_layer->size();
+    double scale = renderScale();
+    BoundProgram program = useShader("layer");
+    program->setUniformValue("texScale", QPointF(m_savedViewport[2] * scale / size.width(), m_savedViewport[3] * scale / size.height()));
+    program.bindTexture("layer", 0, m_layer->texture());
+    program.bindVertexArray(m_layerArray);
+    glDrawArrays(GL_TRIANGLES, 0, m_layerQuad.count());
+  }
+
+  glBlendFuncSeparate(m_savedBlend[0], m_savedBlend[1], m_savedBlend[2], m_savedBlend[3]);
+  glScissor(m_savedScissorBox[0], m_savedScissorBox[1], m_savedScissorBox[2], m_savedScissorBox[3]);
+  if (m_savedScissor) {
+    glEnable(GL_SCISSOR_TEST);
+  } else {
+    glDisable(GL_SCISSOR_TEST);
+  }
+  if (!hadBlend) {
+    glDisable(GL_BLEND);
+  }
+}
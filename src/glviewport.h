@@ -2,8 +2,14 @@
 #define DL_GLVIEWPORT_H
 
 #include <QOpenGLWidget>
+#include <QScopedPointer>
+#include <QTimer>
 #include "glfunctions.h"
+#include "glbuffer.h"
+#include "gpuprofiler.h"
+#include "vertexarray.h"
 class EditorView;
+class QOpenGLFramebufferObject;
 
 class GLViewport : public QOpenGLWidget, public GLFunctions
 {
@@ -17,8 +23,68 @@ public:
   QTransform transform() const;
   EditorView* editor() const;
 
+  // Only takes effect if called before the viewport is first shown.
+  int sampleCount() const;
+  void setSampleCount(int samples);
+
+  // Dynamic resolution: while the user is interacting with the view, meshes
+  // are rendered into a reduced-resolution layer whose scale adapts to keep
+  // each frame inside the frame budget. Full quality returns once input
+  // has been idle for a moment.
+  bool dynamicResolution() const;
+  double frameBudget() const;
+  void setFrameBudget(double msecs);
+  double renderScale() const;
+
+  // Call around each frame so that its GPU time can be measured.
+  void beginFrame();
+  void endFrame();
+
+  // Collects GPU timings for the frame as a whole (keyed by the viewport)
+  // and, depending on its detail level, for each mesh drawn.
+  GPUProfiler* frameProfiler();
+
+  // If the view is currently scaled, redirects rendering of the given area
+  // to the reduced-resolution layer and returns true. endScaledLayer()
+  // must be called afterward to draw the layer into the viewport.
+  bool beginScaledLayer(const QRectF& sceneRect);
+  void endScaledLayer();
+
+public slots:
+  void setDynamicResolution(bool on);
+  void markInteraction();
+
 protected:
   void initializeGL();
+
+private slots:
+  void interactionIdle();
+
+private:
+  void adjustScale();
+
+  bool m_dynamicResolution;
+  bool m_interacting;
+  double m_frameBudget;
+  // The scale to use during interaction, kept between interactions
+  double m_interactiveScale;
+  QTimer m_idleTimer;
+
+  // Frame times are read back a few frames later to avoid stalling, so
+  // remember the scale each frame was drawn at.
+  GPUProfiler m_profiler;
+  bool m_frameOpen;
+  QMap<quint64, double> m_frameScales;
+
+  QScopedPointer<QOpenGLFramebufferObject> m_layer;
+  GLBuffer<QPointF> m_layerQuad;
+  VertexArray m_layerArray;
+  QRect m_layerRect;
+  GLint m_savedFramebuffer;
+  GLint m_savedViewport[4];
+  GLboolean m_savedScissor;
+  GLint m_savedScissorBox[4];
+  GLint m_savedBlend[4];
 };
 
 #endif
@@ -0,0 +1,165 @@
+#include "gpuprofiler.h"
+#include <QOpenGLTimerQuery>
+
+GPUProfiler::GPUProfiler()
+: m_detail(Disabled), m_frame(0), m_active(nullptr)
+{
+  // initializers only
+}
+
+GPUProfiler::~GPUProfiler()
+{
+  // Call finish() first to release the queries in the right context.
+  delete m_active;
+  for (const Pending& pending : m_pending) {
+    delete pending.query;
+  }
+  qDeleteAll(m_free);
+}
+
+GPUProfiler::Detail GPUProfiler::detail() const
+{
+  return m_detail;
+}
+
+void GPUProfiler::setDetail(Detail detail)
+{
+  m_detail = detail;
+}
+
+void GPUProfiler::beginFrame()
+{
+  collect();
+  m_frame++;
+}
+
+quint64 GPUProfiler::currentFrame() const
+{
+  return m_frame;
+}
+
+quint64 GPUProfiler::completedFrame() const
+{
+  if (m_pending.isEmpty()) {
+    return m_stack.isEmpty() ? m_frame : m_frame - 1;
+  }
+  return m_pending.first().frame - 1;
+}
+
+void GPUProfiler::startQuery()
+{
+  if (m_free.isEmpty()) {
+    m_active = new QOpenGLTimerQuery();
+    if (!m_active->create()) {
+      // Timer queries aren't supported. Nothing will be recorded.
+      delete m_active;
+      m_active = nullptr;
+      return;
+    }
+  } else {
+    m_active = m_free.takeLast();
+  }
+  m_active->begin();
+}
+
+void GPUProfiler::stopQuery()
+{
+  if (!m_active) {
+    return;
+  }
+  m_active->end();
+  m_pending << Pending{ m_active, m_stack, m_frame };
+  m_active = nullptr;
+}
+
+void GPUProfiler::begin(const void* owner, int index)
+{
+  stopQuery();
+  m_stack << Key(owner, index);
+  startQuery();
+}
+
+void GPUProfiler::end()
+{
+  if (m_stack.isEmpty()) {
+    qWarning("GPUProfiler::end() called without begin()");
+    return;
+  }
+  stopQuery();
+  m_stack.removeLast();
+  if (!m_stack.isEmpty()) {
+    startQuery();
+  }
+}
+
+void GPUProfiler::collect()
+{
+  while (!m_pending.isEmpty() && m_pending.first().query->isResultAvailable()) {
+    Pending pending = m_pending.takeFirst();
+    record(pending, pending.query->waitForResult() / 1e6);
+    m_free << pending.query;
+  }
+}
+
+void GPUProfiler::finish()
+{
+  while (!m_stack.isEmpty()) {
+    end();
+  }
+  for (const Pending& pending : m_pending) {
+    record(pending, pending.query->waitForResult() / 1e6);
+    delete pending.query;
+  }
+  m_pending.clear();
+  qDeleteAll(m_free);
+  m_free.clear();
+}
+
+void GPUProfiler::record(const Pending& pending, double msecs)
+{
+  for (const Key& key : pending.keys) {
+    GPUTiming& timing = m_timings[key];
+    if (timing.frames && timing.lastFrame == pending.frame) {
+      // Another piece of a sample that was split by a nested sample
+      timing.lastMsecs += msecs;
+    } else {
+      timing.frames++;
+      timing.lastFrame = pending.frame;
+      timing.lastMsecs = msecs;
+    }
+    timing.totalMsecs += msecs;
+    if (timing.lastMsecs > timing.maxMsecs) {
+      timing.maxMsecs = timing.lastMsecs;
+    }
+  }
+}
+
+QList<GPUProfiler::Key> GPUProfiler::keys() const
+{
+  return m_timings.keys();
+}
+
+GPUTiming GPUProfiler::timing(const void* owner, int index) const
+{
+  return m_timings.value(Key(owner, index));
+}
+
+void GPUProfiler::clear()
+{
+  m_timings.clear();
+}
+
+GPUSample::GPUSample(GPUProfiler* profiler, GPUProfiler::Detail level, const void* owner, int index)
+: profiler(profiler && profiler->isEnabled(level) ? profiler : nullptr)
+{
+  if (this->profiler) {
+    this->profiler->begin(owner, index);
+  }
+}
+
+GPUSample::~GPUSample()
+{
+  if (profiler) {
+    profiler->end();
+  }
+}
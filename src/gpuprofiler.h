@@ -0,0 +1,95 @@
+#ifndef DL_GPUPROFILER_H
+#define DL_GPUPROFILER_H
+
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QVector>
+class QOpenGLTimerQuery;
+
+struct GPUTiming
+{
+  // Number of frames in which the sample was recorded
+  int frames = 0;
+  double totalMsecs = 0;
+  double maxMsecs = 0;
+  double lastMsecs = 0;
+  quint64 lastFrame = 0;
+};
+
+// GPUProfiler measures how long the GPU spends on parts of a frame using
+// GL_TIME_ELAPSED queries. Results are read back a few frames later, so
+// measuring never stalls the pipeline.
+//
+// Samples are identified by an owner (such as a mesh) and an index (such as
+// a polygon within the mesh, or -1 for the owner as a whole). Samples may
+// nest and are timed inclusively. Because GL_TIME_ELAPSED queries can't
+// overlap, a nested sample splits its parent into several queries.
+class GPUProfiler
+{
+public:
+  using Key = QPair<const void*, int>;
+
+  enum Detail {
+    Disabled,
+    PerMesh,
+    PerPolygon,
+  };
+
+  GPUProfiler();
+  ~GPUProfiler();
+
+  Detail detail() const;
+  void setDetail(Detail detail);
+  inline bool isEnabled(Detail level) const { return m_detail >= level; }
+
+  void beginFrame();
+  void begin(const void* owner, int index = -1);
+  void end();
+
+  // Reads back any results that are available without waiting.
+  void collect();
+  // Waits for all outstanding results and releases the GL resources.
+  // The current context must be the one the samples were recorded in.
+  void finish();
+
+  quint64 currentFrame() const;
+  // The most recent frame whose results have all been read back
+  quint64 completedFrame() const;
+
+  QList<Key> keys() const;
+  GPUTiming timing(const void* owner, int index = -1) const;
+  void clear();
+
+private:
+  struct Pending {
+    QOpenGLTimerQuery* query;
+    QVector<Key> keys;
+    quint64 frame;
+  };
+
+  void startQuery();
+  void stopQuery();
+  void record(const Pending& pending, double msecs);
+
+  Detail m_detail;
+  quint64 m_frame;
+  QVector<Key> m_stack;
+  QOpenGLTimerQuery* m_active;
+  QList<Pending> m_pending;
+  QList<QOpenGLTimerQuery*> m_free;
+  QMap<Key, GPUTiming> m_timings;
+};
+
+// Times a block of code if the profiler is collecting that much detail.
+class GPUSample
+{
+public:
+  GPUSample(GPUProfiler* profiler, GPUProfiler::Detail level, const void* owner, int index = -1);
+  ~GPUSample();
+
+private:
+  GPUProfiler* profiler;
+};
+
+#endif
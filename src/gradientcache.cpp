@@ -0,0 +1,226 @@
+#include "gradientcache.h"
+#include "glfunctions.h"
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QTransform>
+#include <cmath>
+
+// Extra pixels around each entry so that edge pixels always have a value
+static const int PADDING = 1;
+
+// The atlases are GL_RGBA8.
+static const int TEXEL_BYTES = 4;
+
+// Shared by every mesh's cache. An atlas that doesn't fit in what the others
+// leave is made smaller, down to 256 pixels, or not made at all.
+static int gradientCacheBudget = 64 * 1024 * 1024;
+static qint64 gradientCacheBytes = 0;
+
+int GradientCache::memoryBudget()
+{
+  return gradientCacheBudget;
+}
+
+void GradientCache::setMemoryBudget(int bytes)
+{
+  gradientCacheBudget = bytes;
+}
+
+GradientCache::GradientCache()
+: m_ctx(nullptr), m_size(0), m_shelfX(0), m_shelfY(0), m_shelfHeight(0)
+{
+  // initializers only
+}
+
+GradientCache::~GradientCache()
+{
+  releaseAtlas();
+}
+
+void GradientCache::releaseAtlas()
+{
+  if (m_atlas) {
+    gradientCacheBytes -= qint64(m_size) * m_size * TEXEL_BYTES;
+    m_atlas.reset();
+  }
+}
+
+static bool samePhase(double a, double b)
+{
+  double delta = a - b;
+  return std::abs(delta - std::round(delta)) < 1e-3;
+}
+
+bool GradientCache::begin(GLFunctions* gl, const QTransform& transform, const QPointF& offset, int numPolygons)
+{
+  QOpenGLContext* ctx = QOpenGLContext::currentContext();
+  if (ctx != m_ctx) {
+    // The atlas belongs to a different context (or none at all).
+    releaseAtlas();
+    m_ctx = ctx;
+  }
+
+  // A mesh can't show more than the viewport, so there's no point in an
+  // atlas bigger than that.
+  GLint maxSize = 0;
+  GLint viewport[4];
+  gl->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  gl->glGetIntegerv(GL_VIEWPORT, viewport);
+  qint64 available = gradientCacheBudget - gradientCacheBytes;
+  if (m_atlas) {
+    available += qint64(m_size) * m_size * TEXEL_BYTES;
+  }
+  int size = 1;
+  while (size * 2 <= maxSize && size < qMax(viewport[2], viewport[3]) && qint64(size * 2) * size * 2 * TEXEL_BYTES <= available) {
+    size *= 2;
+  }
+  if (size < 256) {
+    releaseAtlas();
+    return false;
+  }
+  if (!m_atlas || m_size != size) {
+    releaseAtlas();
+    m_size = size;
+    m_atlas.reset(new QOpenGLFramebufferObject(size, size, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_RGBA8));
+    gradientCacheBytes += qint64(size) * size * TEXEL_BYTES;
+    reset();
+  }
+
+  if (m_entries.length() != numPolygons) {
+    m_entries.resize(numPolygons);
+    m_records.resize(numPolygons);
+    reset();
+  }
+
+  QPointF translate(transform.dx() + offset.x() * transform.m11(), transform.dy() + offset.y() * transform.m22());
+  QPointF zoom(transform.m11() * viewport[2] / 2, transform.m22() * viewport[3] / 2);
+  m_origin = QPointF(viewport[0] + (translate.x() + 1) * viewport[2] / 2, viewport[1] + (translate.y() + 1) * viewport[3] / 2);
+
+  QStringList defines = gl->meshDefines();
+  if (defines != m_defines) {
+    m_defines = defines;
+    reset();
+  }
+
+  if (zoom != m_zoom || !samePhase(m_origin.x(), m_builtOrigin.x()) || !samePhase(m_origin.y(), m_builtOrigin.y())) {
+    // Wait for the view to settle before rebuilding the cache.
+    m_zoom = zoom;
+    m_builtOrigin = m_origin;
+    reset();
+    return false;
+  }
+  return true;
+}
+
+void GradientCache::reset()
+{
+  m_shelfX = 0;
+  m_shelfY = 0;
+  m_shelfHeight = 0;
+  int n = m_entries.length();
+  for (int i = 0; i < n; i++) {
+    m_entries[i] = Entry{ QRect(), false };
+    m_records[i] = QVector4D(0, 0, 0, 0);
+  }
+}
+
+void GradientCache::clear()
+{
+  m_entries.clear();
+  m_records = QVector<QVector4D>();
+  m_shelfX = 0;
+  m_shelfY = 0;
+  m_shelfHeight = 0;
+}
+
+void GradientCache::invalidate(int polygon)
+{
+  if (polygon < m_entries.length() && m_entries[polygon].valid) {
+    m_entries[polygon].valid = false;
+    m_records[polygon] = QVector4D(0, 0, 0, 0);
+  }
+}
+
+bool GradientCache::isValid(int polygon) const
+{
+  return polygon < m_entries.length() && m_entries[polygon].valid;
+}
+
+QRectF GradientCache::windowRect(const QRectF& sceneRect) const
+{
+  QRectF rect(
+    sceneRect.left() * m_zoom.x() + m_origin.x(),
+    sceneRect.top() * m_zoom.y() + m_origin.y(),
+    sceneRect.width() * m_zoom.x(),
+    sceneRect.height() * m_zoom.y()
+  );
+  return rect.normalized();
+}
+
+bool GradientCache::allocate(int polygon, const QRectF& windowRect, QPointF* scale, QPointF* translate, QRect* atlasRect)
+{
+  if (!m_atlas || polygon >= m_entries.length()) {
+    return false;
+  }
+
+  // Work in the window coordinates that the atlas was built with.
+  QPointF pan = panOffset();
+  QRect bounds = windowRect.translated(pan).toAlignedRect().adjusted(-PADDING, -PADDING, PADDING, PADDING);
+  int w = bounds.width();
+  int h = bounds.height();
+  if (w > m_size / 4 || h > m_size / 4) {
+    // Big polygons would crowd out everything else, and at this
+    // size they are cheap to draw relative to the pixels they cover.
+    return false;
+  }
+
+  Entry& entry = m_entries[polygon];
+  QRect rect;
+  if (entry.rect.width() >= w && entry.rect.height() >= h) {
+    rect = QRect(entry.rect.topLeft(), QSize(w, h));
+  } else {
+    if (m_shelfX + w > m_size) {
+      m_shelfX = 0;
+      m_shelfY += m_shelfHeight;
+      m_shelfHeight = 0;
+    }
+    if (m_shelfY + h > m_size) {
+      return false;
+    }
+    rect = QRect(m_shelfX, m_shelfY, w, h);
+    m_shelfX += w;
+    m_shelfHeight = qMax(m_shelfHeight, h);
+  }
+
+  QPoint shift = rect.topLeft() - bounds.topLeft();
+  entry.rect = rect;
+  entry.valid = true;
+  m_records[polygon] = QVector4D(shift.x(), shift.y(), 1, 0);
+
+  double ndcScale = 2.0 / m_size;
+  *scale = m_zoom * ndcScale;
+  *translate = (m_builtOrigin + shift) * ndcScale - QPointF(1, 1);
+  *atlasRect = rect;
+  return true;
+}
+
+QOpenGLFramebufferObject* GradientCache::atlas() const
+{
+  return m_atlas.data();
+}
+
+GLBuffer<QVector4D>& GradientCache::records()
+{
+  return m_records;
+}
+
+QPointF GradientCache::panOffset() const
+{
+  QPointF pan = m_builtOrigin - m_origin;
+  return QPointF(std::round(pan.x()), std::round(pan.y()));
+}
+
+int GradientCache::atlasSize() const
+{
+  return m_size;
+}
@@ -0,0 +1,81 @@
+#ifndef DL_GRADIENTCACHE_H
+#define DL_GRADIENTCACHE_H
+
+#include <QVector>
+#include <QRect>
+#include <QPointF>
+#include <QScopedPointer>
+#include <QStringList>
+#include "glbuffer.h"
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+class QTransform;
+class GLFunctions;
+
+// GradientCache stores pre-rendered polygons in a texture atlas so that
+// unchanged polygons can be copied to the screen instead of being
+// evaluated again on every repaint.
+//
+// Entries are aligned to the window's pixel grid, so the cache is only valid
+// for one zoom level, subpixel offset and set of shader options. Panning by
+// whole pixels keeps the cache; anything else throws it away and it is
+// rebuilt once the view stops changing.
+class GradientCache
+{
+public:
+  // The most texture memory all caches' atlases may use together
+  static int memoryBudget();
+  static void setMemoryBudget(int bytes);
+
+  GradientCache();
+  ~GradientCache();
+
+  // Call once per frame before using the cache. Returns false if the cache
+  // can't be used for this frame.
+  bool begin(GLFunctions* gl, const QTransform& transform, const QPointF& offset, int numPolygons);
+
+  void clear();
+  void invalidate(int polygon);
+  bool isValid(int polygon) const;
+
+  // Reserves space in the atlas for a polygon covering windowRect.
+  // On success, returns true and sets the affine transform that maps
+  // scene coordinates to atlas NDC for rasterizing the polygon.
+  bool allocate(int polygon, const QRectF& windowRect, QPointF* scale, QPointF* translate, QRect* atlasRect);
+
+  QOpenGLFramebufferObject* atlas() const;
+  GLBuffer<QVector4D>& records();
+  QPointF panOffset() const;
+  int atlasSize() const;
+
+  // Maps scene coordinates to window coordinates for the current frame.
+  QRectF windowRect(const QRectF& sceneRect) const;
+
+private:
+  struct Entry {
+    QRect rect;
+    bool valid;
+  };
+
+  void reset();
+  void releaseAtlas();
+
+  QOpenGLContext* m_ctx;
+  QScopedPointer<QOpenGLFramebufferObject> m_atlas;
+  int m_size;
+
+  // Shelf packing state
+  int m_shelfX, m_shelfY, m_shelfHeight;
+
+  QVector<Entry> m_entries;
+  // Per polygon: xy = offset from window coordinates to atlas coordinates,
+  // z = 1 if the polygon is cached.
+  GLBuffer<QVector4D> m_records;
+
+  // Window transform for the current frame, and the one the atlas was built with
+  QPointF m_zoom, m_origin, m_builtOrigin;
+  // The shader options the atlas was built with
+  QStringList m_defines;
+};
+
+#endif
@@ -7,20 +7,28 @@ GripItem::GripItem(QGraphicsItem* parent)
 {
   setFlag(QGraphicsItem::ItemIsMovable, true);
   setFlag(QGraphicsItem::ItemIsSelectable, true);
+  setFlag(QGraphicsItem::ItemHasNoContents, dynamic_cast<MeshItem*>(parent) != nullptr);
 }
 
 QVariant GripItem::itemChange(QGraphicsItem::GraphicsItemChange change, const QVariant& value)
 {
   if (change == ItemPositionHasChanged) {
     emit moved(this, value.toPointF());
+  } else if (change == ItemParentHasChanged) {
+    // Meshes draw all of their grips at once.
+    setFlag(QGraphicsItem::ItemHasNoContents, dynamic_cast<MeshItem*>(parentItem()) != nullptr);
+  } else if (change == ItemSelectedHasChanged) {
+    if (MeshItem* mesh = dynamic_cast<MeshItem*>(parentItem())) {
+      mesh->updateGrip(this);
+    }
   }
   return value;
 }
 
 void GripItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
 {
-  MeshItem* mesh = dynamic_cast<MeshItem*>(parentItem());
-  if (mesh && !mesh->verticesVisible()) {
+  if (dynamic_cast<MeshItem*>(parentItem())) {
+    // Drawn by the mesh's GripLayerItem
     return;
   }
   MarkerItem::paint(painter, option, widget);
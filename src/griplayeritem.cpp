@@ -0,0 +1,142 @@
+#include "griplayeritem.h"
+#include "meshitem.h"
+#include "gripitem.h"
+#include "dreamproject.h"
+#include "glfunctions.h"
+#include <QOpenGLContext>
+#include <QStyleOptionGraphicsItem>
+#include <QPainter>
+
+// Half the size of the quad drawn for each grip, in pixels. This covers the
+// 9px frame and its 3px outline.
+static const double GRIP_RADIUS = 6.0;
+
+GripLayerItem::GripLayerItem(MeshItem* mesh)
+: MeshLayerItem(mesh, GRIP_RADIUS)
+{
+  // Above the edges, alongside the grips themselves
+  setZValue(1);
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+  setAcceptedMouseButtons(Qt::NoButton);
+
+  instances.setAttributeBuffer(0, &positions, 0, -1, 1);
+  instances.setAttributeBuffer(1, &colors, 0, -1, 1);
+  instances.setAttributeBuffer(2, &flags, 0, -1, 1);
+}
+
+QRectF GripLayerItem::boundingRect() const
+{
+  return gripRect.adjusted(-margin, -margin, margin, margin);
+}
+
+void GripLayerItem::updateGrip(const QPointF& pos)
+{
+  if (!gripRect.contains(pos)) {
+    prepareGeometryChange();
+    gripRect.setCoords(
+      qMin(gripRect.left(), pos.x()),
+      qMin(gripRect.top(), pos.y()),
+      qMax(gripRect.right(), pos.x()),
+      qMax(gripRect.bottom(), pos.y())
+    );
+  }
+  update(QRectF(pos.x() - margin, pos.y() - margin, margin * 2, margin * 2));
+}
+
+void GripLayerItem::updateGeometry()
+{
+  prepareGeometryChange();
+  QPolygonF centers;
+  for (GripItem* grip : mesh->grips()) {
+    centers << grip->pos();
+  }
+  gripRect = centers.boundingRect();
+  update();
+}
+
+void GripLayerItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget*)
+{
+  if (DreamProject* project = dynamic_cast<DreamProject*>(scene())) {
+    if (project->isExporting()) {
+      return;
+    }
+  }
+  if (!mesh->verticesVisible()) {
+    return;
+  }
+
+  QRectF exposed = option->exposedRect.adjusted(-margin, -margin, margin, margin);
+  QPolygonF gripPositions;
+  QVector<QVector4D> gripColors;
+  QVector<QVector2D> gripFlags;
+  for (GripItem* grip : mesh->grips()) {
+    // Grips that aren't in the mesh yet draw themselves.
+    if (grip->parentItem() != mesh || !grip->isVisible() || !exposed.contains(grip->pos())) {
+      continue;
+    }
+    QColor color = grip->color();
+    gripPositions << grip->pos();
+    gripColors << QVector4D(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+    gripFlags << QVector2D(grip->isSmooth() ? 1 : 0, grip->isSelected() ? 1 : 0);
+  }
+  if (gripPositions.isEmpty()) {
+    return;
+  }
+  positions = gripPositions;
+  colors = gripColors;
+  flags = gripFlags;
+
+  painter->beginNativePainting();
+  GLFunctions* gl = GLFunctions::instance(QOpenGLContext::currentContext());
+  if (gl) {
+    QTransform transform = gl->transform();
+    QPointF origin = scenePos();
+    QPointF translate(transform.dx() + origin.x() * transform.m11(), transform.dy() + origin.y() * transform.m22());
+    GLint viewport[4];
+    gl->glGetIntegerv(GL_VIEWPORT, viewport);
+    QColor selection = option->palette.color(QPalette::Highlight);
+
+    // As with the mesh itself, everything outside the exposed area has to
+    // be left alone.
+    GLboolean hadScissor = gl->glIsEnabled(GL_SCISSOR_TEST);
+    GLint oldScissorBox[4];
+    gl->glGetIntegerv(GL_SCISSOR_BOX, oldScissorBox);
+    QRect clip = gl->deviceRect(mapRectToScene(option->exposedRect));
+    if (hadScissor) {
+      clip &= QRect(oldScissorBox[0], oldScissorBox[1], oldScissorBox[2], oldScissorBox[3]);
+    }
+    gl->glEnable(GL_SCISSOR_TEST);
+    gl->glScissor(clip.x(), clip.y(), clip.width(), clip.height());
+
+    GLboolean hadBlend = gl->glIsEnabled(GL_BLEND);
+    GLint oldBlend[4];
+    gl->glGetIntegerv(GL_BLEND_SRC_RGB, &oldBlend[0]);
+    gl->glGetIntegerv(GL_BLEND_DST_RGB, &oldBlend[1]);
+    gl->glGetIntegerv(GL_BLEND_SRC_ALPHA, &oldBlend[2]);
+    gl->glGetIntegerv(GL_BLEND_DST_ALPHA, &oldBlend[3]);
+    gl->glEnable(GL_BLEND);
+    gl->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    {
+      BoundProgram program = gl->useShader("grips");
+      program->setUniformValue("translate", translate);
+      program->setUniformValue("scale", transform.m11(), transform.m22());
+      program->setUniformValue("viewportSize", QPointF(viewport[2], viewport[3]));
+      program->setUniformValue("radius", GLfloat(GRIP_RADIUS));
+      program->setUniformValue("highlightColor", QColor(Qt::white));
+      program->setUniformValue("selectionColor", selection);
+      program.bindVertexArray(instances);
+      gl->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, gripPositions.length());
+    }
+
+    gl->glBlendFuncSeparate(oldBlend[0], oldBlend[1], oldBlend[2], oldBlend[3]);
+    if (!hadBlend) {
+      gl->glDisable(GL_BLEND);
+    }
+    gl->glScissor(oldScissorBox[0], oldScissorBox[1], oldScissorBox[2], oldScissorBox[3]);
+    if (!hadScissor) {
+      gl->glDisable(GL_SCISSOR_TEST);
+    }
+  }
+  painter->endNativePainting();
+}
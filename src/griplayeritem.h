@@ -0,0 +1,36 @@
+#ifndef DL_GRIPLAYERITEM_H
+#define DL_GRIPLAYERITEM_H
+
+#include "glbuffer.h"
+#include "vertexarray.h"
+#include "meshlayeritem.h"
+class MeshItem;
+
+// GripLayerItem draws all of a mesh's grips with one instanced draw call.
+// The GripItems themselves stay in the scene for hit testing and selection
+// but don't paint anything while they belong to a mesh.
+class GripLayerItem : public MeshLayerItem
+{
+public:
+  GripLayerItem(MeshItem* mesh);
+
+  QRectF boundingRect() const;
+  void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget);
+
+  // Repaints the grip drawn at pos, in mesh coordinates.
+  void updateGrip(const QPointF& pos);
+  // Recomputes the area covered by the grips. Call when grips are added
+  // or removed.
+  void updateGeometry();
+
+private:
+  // The bounding rect of the grips' centers
+  QRectF gripRect;
+
+  GLBuffer<QPointF> positions;
+  GLBuffer<QVector4D> colors;
+  GLBuffer<QVector2D> flags;
+  VertexArray instances;
+};
+
+#endif
@@ -0,0 +1,593 @@
+#include "imagestreamwriter.h"
+#include <QFileInfo>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QtEndian>
+#include <QtDebug>
+#include <QtZlib/zlib.h>
+
+// An encoder receives every row of the image in order, as
+// ARGB32_Premultiplied pixels. It runs on the encoder thread.
+class ImageEncoder
+{
+public:
+  ImageEncoder(QIODevice* device, const QSize& size, int dpi)
+  : device(device), size(size), dpi(dpi)
+  {
+    // initializers only
+  }
+  virtual ~ImageEncoder() {}
+
+  virtual bool begin() = 0;
+  virtual bool writeRow(const QRgb* row) = 0;
+  virtual bool end() = 0;
+
+  QString error;
+
+protected:
+  bool write(const QByteArray& data)
+  {
+    if (device->write(data) != data.size()) {
+      error = device->errorString();
+      return false;
+    }
+    return true;
+  }
+
+  QIODevice* device;
+  QSize size;
+  int dpi;
+};
+
+namespace {
+
+template <typename T>
+void append(QByteArray* data, T value)
+{
+  char bytes[sizeof(T)];
+  qToLittleEndian(value, bytes);
+  data->append(bytes, sizeof(T));
+}
+
+template <typename T>
+void appendBigEndian(QByteArray* data, T value)
+{
+  char bytes[sizeof(T)];
+  qToBigEndian(value, bytes);
+  data->append(bytes, sizeof(T));
+}
+
+// Writes RGBA PNGs with the Sub filter, which suits smooth gradients, and
+// flushes an IDAT chunk whenever the compressor's output buffer fills up.
+class PngEncoder : public ImageEncoder
+{
+public:
+  static const int CHUNK_SIZE = 256 * 1024;
+
+  PngEncoder(QIODevice* device, const QSize& size, int dpi)
+  : ImageEncoder(device, size, dpi), started(false), filtered(1 + size.width() * 4, 0), output(CHUNK_SIZE, 0)
+  {
+    // initializers only
+  }
+
+  ~PngEncoder()
+  {
+    if (started) {
+      deflateEnd(&stream);
+    }
+  }
+
+  bool begin() override
+  {
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      error = "unable to initialize zlib";
+      return false;
+    }
+    started = true;
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = output.size();
+
+    QByteArray header;
+    appendBigEndian<quint32>(&header, size.width());
+    appendBigEndian<quint32>(&header, size.height());
+    // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlacing
+    header.append("\x08\x06\x00\x00\x00", 5);
+
+    // The resolution, in pixels per meter
+    QByteArray physical;
+    quint32 dpm = qRound(dpi / 0.0254);
+    appendBigEndian<quint32>(&physical, dpm);
+    appendBigEndian<quint32>(&physical, dpm);
+    physical.append('\x01');
+    return write(QByteArray("\x89PNG\r\n\x1a\n", 8)) && writeChunk("IHDR", header) && writeChunk("pHYs", physical);
+  }
+
+  bool writeRow(const QRgb* row) override
+  {
+    uchar* out = reinterpret_cast<uchar*>(filtered.data());
+    // Sub: each byte is stored as the difference from the pixel to its left.
+    *out++ = 1;
+    uchar prev[4] = { 0, 0, 0, 0 };
+    for (int x = 0; x < size.width(); x++) {
+      QRgb pixel = qUnpremultiply(row[x]);
+      uchar curr[4] = { uchar(qRed(pixel)), uchar(qGreen(pixel)), uchar(qBlue(pixel)), uchar(qAlpha(pixel)) };
+      for (int c = 0; c < 4; c++) {
+        *out++ = curr[c] - prev[c];
+        prev[c] = curr[c];
+      }
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(filtered.data());
+    stream.avail_in = filtered.size();
+    return compress(Z_NO_FLUSH);
+  }
+
+  bool end() override
+  {
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+    return compress(Z_FINISH) && flushOutput() && writeChunk("IEND", QByteArray());
+  }
+
+private:
+  bool compress(int flush)
+  {
+    while (true) {
+      int result = deflate(&stream, flush);
+      if (result == Z_STREAM_ERROR) {
+        error = "zlib error";
+        return false;
+      }
+      if (stream.avail_out == 0) {
+        if (!flushOutput()) {
+          return false;
+        }
+        continue;
+      }
+      if (flush == Z_FINISH ? result == Z_STREAM_END : stream.avail_in == 0) {
+        return true;
+      }
+    }
+  }
+
+  bool flushOutput()
+  {
+    int length = output.size() - stream.avail_out;
+    if (length > 0 && !writeChunk("IDAT", QByteArray::fromRawData(output.constData(), length))) {
+      return false;
+    }
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = output.size();
+    return true;
+  }
+
+  bool writeChunk(const char* type, const QByteArray& data)
+  {
+    QByteArray chunk;
+    appendBigEndian<quint32>(&chunk, data.size());
+    chunk.append(type, 4);
+    chunk.append(data);
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(chunk.constData() + 4), chunk.size() - 4);
+    appendBigEndian<quint32>(&chunk, crc);
+    return write(chunk);
+  }
+
+  z_stream stream;
+  bool started;
+  QByteArray filtered;
+  QByteArray output;
+};
+
+// Writes uncompressed RGBA TIFFs with premultiplied ("associated") alpha.
+// The rows are written as they arrive and the directory goes at the end,
+// once the file's layout is known. Files over 4 GB are written as BigTIFF.
+class TiffEncoder : public ImageEncoder
+{
+public:
+  static const int ROWS_PER_STRIP = 64;
+
+  TiffEncoder(QIODevice* device, const QSize& size, int dpi)
+  : ImageEncoder(device, size, dpi), rowBytes(size.width() * 4), rowData(rowBytes, 0)
+  {
+    dataBytes = quint64(rowBytes) * size.height();
+    // Leave room for the directory and the strip tables.
+    big = dataBytes + 64 * 1024 + quint64(size.height()) * 2 >= 0xFFFFFFFFull;
+    dataOffset = big ? 16 : 8;
+  }
+
+  bool begin() override
+  {
+    QByteArray header("II", 2);
+    if (big) {
+      append<quint16>(&header, 43);
+      append<quint16>(&header, 8);
+      append<quint16>(&header, 0);
+      append<quint64>(&header, 0);
+    } else {
+      append<quint16>(&header, 42);
+      append<quint32>(&header, 0);
+    }
+    return write(header);
+  }
+
+  bool writeRow(const QRgb* row) override
+  {
+    uchar* out = reinterpret_cast<uchar*>(rowData.data());
+    for (int x = 0; x < size.width(); x++) {
+      QRgb pixel = row[x];
+      *out++ = qRed(pixel);
+      *out++ = qGreen(pixel);
+      *out++ = qBlue(pixel);
+      *out++ = qAlpha(pixel);
+    }
+    return write(rowData);
+  }
+
+  bool end() override
+  {
+    // Rationals are stored as a numerator and a denominator.
+    enum { SHORT = 3, LONG = 4, RATIONAL = 5, LONG8 = 16 };
+    struct Entry {
+      quint16 tag, type;
+      QVector<quint64> values;
+    };
+
+    int numStrips = (size.height() + ROWS_PER_STRIP - 1) / ROWS_PER_STRIP;
+    QVector<quint64> offsets, counts;
+    for (int i = 0; i < numStrips; i++) {
+      int rows = qMin(ROWS_PER_STRIP, size.height() - i * ROWS_PER_STRIP);
+      offsets << dataOffset + quint64(i) * ROWS_PER_STRIP * rowBytes;
+      counts << quint64(rows) * rowBytes;
+    }
+    QVector<Entry> entries{
+      { 256, LONG, { quint64(size.width()) } },
+      { 257, LONG, { quint64(size.height()) } },
+      { 258, SHORT, { 8, 8, 8, 8 } },
+      { 259, SHORT, { 1 } },  // no compression
+      { 262, SHORT, { 2 } },  // RGB
+      { 273, quint16(big ? LONG8 : LONG), offsets },
+      { 277, SHORT, { 4 } },
+      { 278, LONG, { ROWS_PER_STRIP } },
+      { 279, LONG, counts },
+      { 282, RATIONAL, { quint64(dpi), 1 } },
+      { 283, RATIONAL, { quint64(dpi), 1 } },
+      { 284, SHORT, { 1 } },  // interleaved
+      { 296, SHORT, { 2 } },  // inches
+      { 338, SHORT, { 1 } },  // associated alpha
+    };
+
+    // The directory starts after the pixels, on a word boundary. Values
+    // that don't fit in an entry follow it.
+    quint64 ifdOffset = (dataOffset + dataBytes + 1) & ~quint64(1);
+    int fieldSize = big ? 8 : 4;
+    int entrySize = big ? 20 : 12;
+    quint64 extraOffset = ifdOffset + (big ? 8 : 2) + entries.size() * entrySize + fieldSize;
+
+    QByteArray ifd, extra;
+    if (ifdOffset > dataOffset + dataBytes) {
+      ifd.append('\0');
+    }
+    if (big) {
+      append<quint64>(&ifd, entries.size());
+    } else {
+      append<quint16>(&ifd, entries.size());
+    }
+    for (const Entry& entry : entries) {
+      QByteArray values;
+      for (quint64 value : entry.values) {
+        if (entry.type == SHORT) {
+          append<quint16>(&values, value);
+        } else if (entry.type == LONG || entry.type == RATIONAL) {
+          append<quint32>(&values, value);
+        } else {
+          append<quint64>(&values, value);
+        }
+      }
+      append<quint16>(&ifd, entry.tag);
+      append<quint16>(&ifd, entry.type);
+      int count = entry.type == RATIONAL ? entry.values.size() / 2 : entry.values.size();
+      if (big) {
+        append<quint64>(&ifd, count);
+      } else {
+        append<quint32>(&ifd, count);
+      }
+      if (values.size() <= fieldSize) {
+        ifd.append(values);
+        ifd.append(QByteArray(fieldSize - values.size(), '\0'));
+      } else {
+        quint64 offset = extraOffset + extra.size();
+        if (big) {
+          append<quint64>(&ifd, offset);
+        } else {
+          append<quint32>(&ifd, offset);
+        }
+        extra.append(values);
+        if (extra.size() & 1) {
+          extra.append('\0');
+        }
+      }
+    }
+    // No further directories
+    ifd.append(QByteArray(fieldSize, '\0'));
+
+    if (!write(ifd) || !write(extra)) {
+      return false;
+    }
+
+    // Point the header at the directory.
+    QByteArray pointer;
+    if (big) {
+      append<quint64>(&pointer, ifdOffset);
+    } else {
+      append<quint32>(&pointer, ifdOffset);
+    }
+    return device->seek(big ? 8 : 4) && write(pointer);
+  }
+
+private:
+  int rowBytes;
+  QByteArray rowData;
+  quint64 dataBytes;
+  quint64 dataOffset;
+  bool big;
+};
+
+// Writes binary PPMs. There is no alpha channel, so the image is
+// composited over white, like the page in the editor.
+class PpmEncoder : public ImageEncoder
+{
+public:
+  PpmEncoder(QIODevice* device, const QSize& size)
+  : ImageEncoder(device, size, 0), rowData(size.width() * 3, 0)
+  {
+    // initializers only
+  }
+
+  bool begin() override
+  {
+    return write(QStringLiteral("P6\n%1 %2\n255\n").arg(size.width()).arg(size.height()).toLatin1());
+  }
+
+  bool writeRow(const QRgb* row) override
+  {
+    uchar* out = reinterpret_cast<uchar*>(rowData.data());
+    for (int x = 0; x < size.width(); x++) {
+      QRgb pixel = row[x];
+      int white = 255 - qAlpha(pixel);
+      *out++ = qRed(pixel) + white;
+      *out++ = qGreen(pixel) + white;
+      *out++ = qBlue(pixel) + white;
+    }
+    return write(rowData);
+  }
+
+  bool end() override
+  {
+    return true;
+  }
+
+private:
+  QByteArray rowData;
+};
+
+}
+
+// Encodes one band at a time. writeBand() hands over the next band only
+// once the previous one is done, so the caller can render one band while
+// another is encoded, but no more than that.
+class EncoderThread : public QThread
+{
+public:
+  EncoderThread(ImageEncoder* encoder)
+  : encoder(encoder), busy(false), finished(false), failed(false), busyNsecs(0)
+  {
+    // initializers only
+  }
+
+  bool queue(const QImage& band)
+  {
+    QMutexLocker lock(&mutex);
+    while (busy && !failed) {
+      idle.wait(&mutex);
+    }
+    if (failed) {
+      return false;
+    }
+    pending = band;
+    busy = true;
+    ready.wakeOne();
+    return true;
+  }
+
+  // Waits for the last band and stops the thread. Returns false if any
+  // band failed to encode.
+  bool finish()
+  {
+    {
+      QMutexLocker lock(&mutex);
+      finished = true;
+      ready.wakeOne();
+    }
+    wait();
+    return !failed;
+  }
+
+  // How long the thread spent encoding, as opposed to waiting for bands
+  qint64 encodeNsecs() const
+  {
+    return busyNsecs;
+  }
+
+protected:
+  void run() override
+  {
+    while (true) {
+      QImage band;
+      {
+        QMutexLocker lock(&mutex);
+        while (!busy && !finished) {
+          ready.wait(&mutex);
+        }
+        if (!busy) {
+          return;
+        }
+        band = pending;
+      }
+
+      QElapsedTimer timer;
+      timer.start();
+      bool ok = true;
+      for (int y = 0; ok && y < band.height(); y++) {
+        ok = encoder->writeRow(reinterpret_cast<const QRgb*>(band.constScanLine(y)));
+      }
+      band = QImage();
+
+      QMutexLocker lock(&mutex);
+      busyNsecs += timer.nsecsElapsed();
+      pending = QImage();
+      busy = false;
+      failed = failed || !ok;
+      idle.wakeAll();
+      if (failed) {
+        return;
+      }
+    }
+  }
+
+private:
+  ImageEncoder* encoder;
+  QMutex mutex;
+  QWaitCondition ready, idle;
+  QImage pending;
+  bool busy, finished, failed;
+  qint64 busyNsecs;
+};
+
+bool ImageStreamWriter::supportsFormat(const QByteArray& format)
+{
+  QByteArray f = format.toLower();
+  return f == "png" || f == "tif" || f == "tiff" || f == "ppm";
+}
+
+QByteArray ImageStreamWriter::formatForPath(const QString& path)
+{
+  return QFileInfo(path).suffix().toLower().toLatin1();
+}
+
+ImageStreamWriter::ImageStreamWriter(const QString& path, const QByteArray& format, const QSize& size, int dpi)
+: m_file(path), m_size(size), m_rowsQueued(0), m_closed(false), m_encodeNsecs(0)
+{
+  QByteArray f = format.toLower();
+  if (f == "png") {
+    m_encoder.reset(new PngEncoder(&m_file, size, dpi));
+  } else if (f == "tif" || f == "tiff") {
+    m_encoder.reset(new TiffEncoder(&m_file, size, dpi));
+  } else if (f == "ppm") {
+    m_encoder.reset(new PpmEncoder(&m_file, size));
+  }
+}
+
+ImageStreamWriter::~ImageStreamWriter()
+{
+  if (!m_closed) {
+    abort();
+  }
+}
+
+bool ImageStreamWriter::open()
+{
+  if (!m_encoder) {
+    m_error = "unsupported image format";
+    return false;
+  }
+  if (m_size.isEmpty()) {
+    m_error = "empty image";
+    return false;
+  }
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    m_error = m_file.errorString();
+    return false;
+  }
+  if (!m_encoder->begin()) {
+    m_error = m_encoder->error;
+    return false;
+  }
+  m_thread.reset(new EncoderThread(m_encoder.data()));
+  m_thread->start();
+  return true;
+}
+
+bool ImageStreamWriter::writeBand(const QImage& band)
+{
+  if (!m_thread) {
+    return false;
+  }
+  if (band.width() != m_size.width() || m_rowsQueued + band.height() > m_size.height()) {
+    m_error = QStringLiteral("band doesn't fit the %1x%2 image").arg(m_size.width()).arg(m_size.height());
+    return false;
+  }
+  QImage pixels = band.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  if (!m_thread->queue(pixels)) {
+    m_error = m_encoder->error;
+    return false;
+  }
+  m_rowsQueued += band.height();
+  return true;
+}
+
+bool ImageStreamWriter::close()
+{
+  if (!m_thread) {
+    return false;
+  }
+  bool ok = m_thread->finish();
+  m_encodeNsecs = m_thread->encodeNsecs();
+  m_thread.reset();
+  QElapsedTimer timer;
+  timer.start();
+  if (!ok) {
+    m_error = m_encoder->error;
+  } else if (m_rowsQueued != m_size.height()) {
+    m_error = QStringLiteral("only %1 of %2 rows were written").arg(m_rowsQueued).arg(m_size.height());
+    ok = false;
+  } else if (!m_encoder->end()) {
+    m_error = m_encoder->error;
+    ok = false;
+  }
+  m_encodeNsecs += timer.nsecsElapsed();
+  m_file.close();
+  if (!ok) {
+    m_file.remove();
+    return false;
+  }
+  m_closed = true;
+  return true;
+}
+
+void ImageStreamWriter::abort()
+{
+  if (m_thread) {
+    m_thread->finish();
+    m_thread.reset();
+  }
+  if (m_file.isOpen()) {
+    m_file.close();
+    m_file.remove();
+  }
+  m_closed = true;
+}
+
+QString ImageStreamWriter::errorString() const
+{
+  return m_error;
+}
+
+double ImageStreamWriter::encodeMsecs() const
+{
+  return m_encodeNsecs / 1e6;
+}
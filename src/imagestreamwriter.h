@@ -0,0 +1,56 @@
+#ifndef DL_IMAGESTREAMWRITER_H
+#define DL_IMAGESTREAMWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QScopedPointer>
+#include <QString>
+class ImageEncoder;
+class EncoderThread;
+
+// ImageStreamWriter saves images that are too large to hold in memory. It
+// takes the image in horizontal bands from top to bottom, each as wide as
+// the image, and encodes each band on a thread of its own while the caller
+// renders the next one. At most two bands are alive at once.
+//
+// PNG and TIFF keep the alpha channel and record the resolution. PPM has
+// neither, so the image is composited over white.
+class ImageStreamWriter
+{
+public:
+  // png, tif, tiff or ppm
+  static bool supportsFormat(const QByteArray& format);
+  // The format for the path's suffix, or an empty array if there isn't one
+  static QByteArray formatForPath(const QString& path);
+
+  ImageStreamWriter(const QString& path, const QByteArray& format, const QSize& size, int dpi);
+  // Removes the file unless close() succeeded.
+  ~ImageStreamWriter();
+
+  bool open();
+  // Blocks until the previous band has been encoded.
+  bool writeBand(const QImage& band);
+  // Waits for the last band and finishes the file. Every row has to have
+  // been written.
+  bool close();
+  // Stops encoding and removes the incomplete file.
+  void abort();
+
+  QString errorString() const;
+  // The time spent encoding, once the writer is closed. Most of it overlaps
+  // with rendering the bands.
+  double encodeMsecs() const;
+
+private:
+  QFile m_file;
+  QSize m_size;
+  int m_rowsQueued;
+  bool m_closed;
+  qint64 m_encodeNsecs;
+  QString m_error;
+  QScopedPointer<ImageEncoder> m_encoder;
+  QScopedPointer<EncoderThread> m_thread;
+};
+
+#endif
@@ -1,10 +1,146 @@
 #include "dlapplication.h"
 #include "mainwindow.h"
+#include "dreamproject.h"
+#include "batchexporter.h"
+#include <QImageWriter>
+#include <iostream>
 
 #define STRINGIFY_(x) #x
 #define STRINGIFY(x) STRINGIFY_(x)
 #define DREAMLINE_VERSION_STRING STRINGIFY(DREAMLINE_VERSION)
 
+static int validateEvaluator(const QStringList& paths)
+{
+  int exitCode = 0;
+  for (const QString& path : paths) {
+    DreamProject project(QSizeF(8.5, 11));
+    try {
+      project.open(path);
+    } catch (OpenException& err) {
+      std::cerr << qPrintable(path) << ": " << err.what() << std::endl;
+      exitCode = 1;
+      continue;
+    }
+    QPoint location;
+    int error = project.evaluatorError(100, &location);
+    std::cout << qPrintable(path) << ": max error " << error << "/255";
+    if (error > 0) {
+      std::cout << " at (" << location.x() << ", " << location.y() << ")";
+    }
+    std::cout << std::endl;
+  }
+  return exitCode;
+}
+
+static int writeProfile(const QStringList& paths, const QString& csvPath)
+{
+  if (paths.isEmpty()) {
+    std::cerr << "--profile-csv requires a file to render" << std::endl;
+    return 1;
+  }
+  DreamProject project(QSizeF(8.5, 11));
+  try {
+    project.open(paths.first());
+  } catch (OpenException& err) {
+    std::cerr << qPrintable(paths.first()) << ": " << err.what() << std::endl;
+    return 1;
+  }
+  if (!project.writeProfile(csvPath)) {
+    std::cerr << qPrintable(csvPath) << ": unable to write profile" << std::endl;
+    return 1;
+  }
+  GLBufferPool::Stats pool = project.bufferPoolStats();
+  std::cout << "buffer pool: " << pool.allocations << " buffers in " << pool.arenas << " arenas, "
+            << (pool.arenaBytes / 1024) << " KiB, " << qRound(pool.occupancy() * 100) << "% occupied, "
+            << qRound(pool.fragmentation() * 100) << "% fragmented" << std::endl;
+  return 0;
+}
+
+static bool exportSettings(const DLApplication& app, int* dpi, QByteArray* format)
+{
+  bool ok = false;
+  *dpi = app.value("dpi", "100").toInt(&ok);
+  if (!ok || *dpi <= 0) {
+    std::cerr << qPrintable(app.value("dpi")) << ": invalid resolution" << std::endl;
+    return false;
+  }
+
+  *format = app.value("format").toLatin1().toLower();
+  if (!format->isEmpty() && !QImageWriter::supportedImageFormats().contains(*format)) {
+    std::cerr << format->constData() << ": unsupported image format" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+static int exportFile(const DLApplication& app)
+{
+  QStringList paths = app.positionalArguments();
+  if (paths.length() != 1) {
+    std::cerr << "--export requires exactly one file to render" << std::endl;
+    return 1;
+  }
+
+  int dpi;
+  QByteArray format;
+  if (!exportSettings(app, &dpi, &format)) {
+    return 1;
+  }
+
+  DreamProject project(QSizeF(8.5, 11));
+  try {
+    project.open(paths.first());
+  } catch (OpenException& err) {
+    std::cerr << qPrintable(paths.first()) << ": " << err.what() << std::endl;
+    return 1;
+  }
+  if (app.isSet("cpu")) {
+    project.setRenderBackend(DreamProject::CPUBackend);
+  }
+
+  QString output = app.value("output");
+  if (!project.exportToFile(output, format, dpi)) {
+    std::cerr << qPrintable(output) << ": unable to write image" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+static int batchExport(const DLApplication& app)
+{
+  int dpi;
+  QByteArray format;
+  if (!exportSettings(app, &dpi, &format)) {
+    return 1;
+  }
+
+  BatchExporter exporter;
+  exporter.setDpi(dpi);
+  if (!format.isEmpty()) {
+    exporter.setFormat(format);
+  }
+  if (app.isSet("cpu")) {
+    exporter.setRenderBackend(DreamProject::CPUBackend);
+  }
+
+  QString outputDir = app.value("dir");
+  if (app.isSet("manifest")) {
+    QString error;
+    if (!exporter.addManifest(app.value("manifest"), outputDir, &error)) {
+      std::cerr << qPrintable(app.value("manifest")) << ": " << qPrintable(error) << std::endl;
+      return 1;
+    }
+  }
+  for (const QString& path : app.positionalArguments()) {
+    exporter.addFiles(path, outputDir);
+  }
+  if (!exporter.jobCount()) {
+    std::cerr << "--batch requires files to render" << std::endl;
+    return 1;
+  }
+  return exporter.run(std::cout) ? 1 : 0;
+}
+
 int main(int argc, char** argv)
 {
   QApplication::setApplicationName("Dreamline");
@@ -12,6 +148,9 @@ int main(int argc, char** argv)
   QApplication::setOrganizationName("Alkahest");
   QApplication::setOrganizationDomain("com.alkahest");
   QApplication::setDesktopFileName("dreamline.desktop");
+  // Exports render in a context of their own that shares buffers and
+  // programs with the viewports.
+  QApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
 
   DLApplication app(argc, argv);
   int exitCode = 0;
@@ -20,6 +159,22 @@ int main(int argc, char** argv)
     return exitCode;
   }
 
+  if (app.isSet("validate-evaluator")) {
+    return validateEvaluator(app.positionalArguments());
+  }
+
+  if (app.isSet("profile-csv")) {
+    return writeProfile(app.positionalArguments(), app.value("csv"));
+  }
+
+  if (app.isSet("export")) {
+    return exportFile(app);
+  }
+
+  if (app.isSet("batch")) {
+    return batchExport(app);
+  }
+
   MainWindow v;
   v.resize(800, 600);
   v.show();
@@ -4,6 +4,7 @@
 #include "dreamproject.h"
 #include <QApplication>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QMenuBar>
 #include <QToolBar>
 #include <QStyle>
@@ -63,6 +64,20 @@ void MainWindow::makeFileMenu()
   aPreview->setCheckable(true);
   QObject::connect(aPreview, SIGNAL(toggled(bool)), editor, SLOT(setPreview(bool)));
 
+  QSettings settings;
+  editor->setFrameBudget(settings.value("frameBudget", 8.0).toDouble());
+  editor->setSampleCount(settings.value("samples", GLFunctions::DEFAULT_SAMPLES).toInt());
+  editor->setAnalyticAntialiasing(settings.value("analyticAntialiasing", true).toBool());
+  if (settings.value("evaluator", "fast").toString() == "reference") {
+    editor->setEvaluatorTier(GLFunctions::ReferenceEvaluator);
+  }
+  QAction* aDynamic = fileBar->addAction(style()->standardIcon(QStyle::SP_MediaSeekForward), tr("Dynamic Resolution"));
+  aDynamic->setToolTip(tr("Render at a lower resolution while editing to keep the view responsive"));
+  aDynamic->setCheckable(true);
+  aDynamic->setChecked(settings.value("dynamicResolution", false).toBool());
+  editor->setDynamicResolution(aDynamic->isChecked());
+  QObject::connect(aDynamic, SIGNAL(toggled(bool)), this, SLOT(setDynamicResolution(bool)));
+
   fileBar->setIconSize(QSize(16, 16));
 }
 
@@ -201,23 +216,40 @@ void MainWindow::fileExport()
     return;
   }
 
-  exportFile(dlg.selectedFiles().first(), dlg.selectedMimeTypeFilter());
+  QSettings settings;
+  bool ok = false;
+  int dpi = QInputDialog::getInt(this, tr("Export Dreamline File"), tr("Resolution (DPI):"), settings.value("exportDpi", 100).toInt(), 1, 4800, 1, &ok);
+  if (!ok) {
+    return;
+  }
+  settings.setValue("exportDpi", dpi);
+
+  exportFile(dlg.selectedFiles().first(), dlg.selectedMimeTypeFilter(), dpi);
 }
 
-void MainWindow::exportFile(const QString& path, const QString& format)
+void MainWindow::exportFile(const QString& path, const QString& format, int dpi)
 {
   exportPath = path;
 
   QByteArray formatCode = QImageWriter::imageFormatsForMimeType(format.toUtf8()).first();
 
-  // TODO: configurable output DPI
-  bool ok = editor->project()->exportToFile(path, formatCode.constData(), 100);
+  QSettings settings;
+  editor->project()->setExportSampleCount(settings.value("exportSamples", 0).toInt());
+
+  bool ok = editor->project()->exportToFile(path, formatCode.constData(), dpi);
 
   if (!ok) {
     QMessageBox::warning(this, tr("Error exporting Dreamline file"), tr("%1 could not be saved.").arg(path));
   }
 }
 
+void MainWindow::setDynamicResolution(bool on)
+{
+  QSettings settings;
+  settings.setValue("dynamicResolution", on);
+  editor->setDynamicResolution(on);
+}
+
 void MainWindow::updateTitle()
 {
   QString name;
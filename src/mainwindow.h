@@ -16,7 +16,7 @@ public:
 
   void openFile(const QString& path);
   void saveFile(const QString& path);
-  void exportFile(const QString& path, const QString& format = "image/png");
+  void exportFile(const QString& path, const QString& format = "image/png", int dpi = 100);
 
 private slots:
   void fileNew();
@@ -25,6 +25,7 @@ private slots:
   void fileSave();
   void fileSaveAs();
   void fileExport();
+  void setDynamicResolution(bool on);
 
 private:
   void makeFileMenu();
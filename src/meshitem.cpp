@@ -1,19 +1,26 @@
 #include "meshitem.h"
 #include "glviewport.h"
 #include "gripitem.h"
+#include "griplayeritem.h"
+#include "edgelayeritem.h"
 #include "edgeitem.h"
 #include "polylineitem.h"
 #include "editorview.h"
 #include "mathutil.h"
+#include "gpuprofiler.h"
 #include <QJsonArray>
+#include <QHash>
 #include <QOpenGLVertexArrayObject>
+#include <QOpenGLFramebufferObject>
 #include <QPainter>
+#include <QStyleOptionGraphicsItem>
 #include <limits>
 
 MeshItem::MeshItem(QGraphicsItem* parent)
-: QObject(nullptr), QGraphicsPolygonItem(parent), m_edgesVisible(true), m_verticesVisible(true)
+: QObject(nullptr), QGraphicsPolygonItem(parent), m_layoutDirty(true), m_storageDirty(true), m_capsDirty(true), m_edgesVisible(true), m_verticesVisible(true)
 {
   setFlag(QGraphicsItem::ItemIsMovable, true);
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
 
   // TODO: It might be a better idea to render this in paint() or
   // DreamProject::drawForeground() instead of using QGraphicsItems.
@@ -28,6 +35,14 @@ MeshItem::MeshItem(QGraphicsItem* parent)
   inner->setPen(pen);
   m_lastVertexFocus->setZValue(100);
   m_lastVertexFocus->hide();
+
+  m_gripLayer = new GripLayerItem(this);
+  m_edgeLayer = new EdgeLayerItem(this);
+
+  m_boundaryArray.setVertexBuffer(&m_boundaryVerts);
+  m_fanArray.setAttributeBuffer(4, &m_fanIndices);
+  m_cacheArray.setAttributeBuffer(0, &m_cacheQuads);
+  m_cacheArray.setAttributeBuffer(4, &m_cacheIndices);
 }
 
 MeshItem::MeshItem(PolyLineItem* polyline, QGraphicsItem* parent)
@@ -81,6 +96,8 @@ MeshItem::MeshItem(const QJsonObject& source, QGraphicsItem* parent)
   }
   setPolygon(boundary);
   updateBoundary();
+  m_gripLayer->updateGeometry();
+  m_edgeLayer->updateGeometry();
 }
 
 QJsonObject MeshItem::serialize() const
@@ -137,6 +154,7 @@ void MeshItem::setEdgesVisible(bool on)
 {
   m_edgesVisible = on;
   update();
+  m_edgeLayer->update();
 }
 
 bool MeshItem::verticesVisible() const
@@ -163,6 +181,7 @@ GripItem* MeshItem::newGrip()
   QObject::connect(grip, SIGNAL(moved(GripItem*, QPointF)), this, SLOT(moveVertex(GripItem*, QPointF)));
   QObject::connect(grip, SIGNAL(colorChanged(MarkerItem*, QColor)), this, SLOT(changeColor(MarkerItem*, QColor)));
   QObject::connect(grip, SIGNAL(smoothChanged(MarkerItem*, bool)), this, SLOT(updateBoundary()));
+  QObject::connect(grip, SIGNAL(smoothChanged(MarkerItem*, bool)), this, SLOT(updateGrip(MarkerItem*)));
   QObject::connect(grip, SIGNAL(destroyed(QObject*)), this, SLOT(gripDestroyed(QObject*)));
   return grip;
 }
@@ -182,6 +201,8 @@ QSet<MeshItem::Polygon*> MeshItem::polygonsContainingVertex(GripItem* vertex)
 
 void MeshItem::moveVertex(GripItem* vertex, const QPointF& pos)
 {
+  QRectF dirty = affectedRect(vertex);
+
   int boundaryIndex = m_boundary.indexOf(vertex);
   if (boundaryIndex >= 0) {
     QPolygonF p = polygon();
@@ -193,28 +214,67 @@ void MeshItem::moveVertex(GripItem* vertex, const QPointF& pos)
   for (Polygon& poly : m_polygons) {
     int index = poly.vertices.indexOf(vertex);
     if (index >= 0) {
+      // The grip has to be erased where it was drawn before.
+      m_gripLayer->updateGrip(poly.vertex(index));
       poly.setVertex(index, pos);
       poly.updateWindingDirection();
+      m_storageDirty = true;
     }
   }
+  m_gripLayer->updateGrip(pos);
+  m_edgeLayer->updateVertex(vertex);
 
   if (vertex == m_lastVertex) {
     m_lastVertexFocus->setPos(pos);
   }
+  update(dirty | affectedRect(vertex));
   emit modified(true);
 }
 
 void MeshItem::changeColor(MarkerItem* vertex, const QColor& color)
 {
+  GripItem* grip = static_cast<GripItem*>(vertex);
   for (Polygon& poly : m_polygons) {
-    int index = poly.vertices.indexOf(static_cast<GripItem*>(vertex));
+    int index = poly.vertices.indexOf(grip);
     if (index >= 0) {
-      poly.colors[index] = QVector4D(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+      poly.setColor(index, color);
+      m_storageDirty = true;
     }
   }
+  update(affectedRect(grip));
+  m_gripLayer->updateGrip(grip->pos());
   emit modified(true);
 }
 
+void MeshItem::updateGrip(MarkerItem* grip)
+{
+  m_gripLayer->updateGrip(grip->pos());
+}
+
+void MeshItem::updateEdgeHover(EdgeItem* edge, bool hovered)
+{
+  m_edgeLayer->setHovered(edge, hovered);
+}
+
+// Returns the area of the mesh whose appearance depends on the given vertex.
+QRectF MeshItem::affectedRect(GripItem* vertex) const
+{
+  QRectF rect;
+  for (const Polygon& poly : m_polygons) {
+    if (poly.vertices.contains(vertex)) {
+      rect |= poly.boundingRect();
+    }
+  }
+  for (const BoundaryCorner& corner : m_corners) {
+    if (corner.vertex == vertex) {
+      QPolygonF tri;
+      tri << corner.prev << corner.midpoint << corner.lastMidpoint;
+      rect |= tri.boundingRect();
+    }
+  }
+  return rect;
+}
+
 void MeshItem::insertVertex(EdgeItem* edge, const QPointF& pos)
 {
   int oldIndex = m_edges.indexOf(edge);
@@ -233,7 +293,9 @@ void MeshItem::insertVertex(EdgeItem* edge, const QPointF& pos)
 
   EdgeItem* newEdge = edge->split(grip);
   QObject::connect(newEdge, SIGNAL(insertVertex(EdgeItem*,QPointF)), this, SLOT(insertVertex(EdgeItem*,QPointF)));
+  QObject::connect(newEdge, SIGNAL(hoverChanged(EdgeItem*,bool)), this, SLOT(updateEdgeHover(EdgeItem*,bool)));
   m_edges.append(newEdge);
+  m_edgeLayer->updateGeometry();
 
   int numRefs = 0;
   for (Polygon& poly : m_polygons) {
@@ -242,6 +304,7 @@ void MeshItem::insertVertex(EdgeItem* edge, const QPointF& pos)
       numRefs++;
     }
   }
+  m_layoutDirty = true;
 
   if (numRefs == 1) {
     // A singly-referenced edge is an exterior edge
@@ -268,6 +331,26 @@ void MeshItem::insertVertex(EdgeItem* edge, const QPointF& pos)
   emit modified(true);
 }
 
+const QVector<GripItem*>& MeshItem::grips() const
+{
+  return m_grips;
+}
+
+const QVector<EdgeItem*>& MeshItem::edges() const
+{
+  return m_edges;
+}
+
+int MeshItem::polygonCount() const
+{
+  return m_polygons.length();
+}
+
+int MeshItem::polygonSize(int index) const
+{
+  return m_polygons[index].vertices.length();
+}
+
 GripItem* MeshItem::activeVertex() const
 {
   return m_lastVertex.data();
@@ -331,10 +414,12 @@ bool MeshItem::splitPolygon(GripItem* v1, GripItem* v2)
   EdgeItem* edge = findOrCreateEdge(v1, v2);
   oldPoly->edges.append(edge);
   newPoly->edges.append(edge);
+  m_edgeLayer->updateGeometry();
 
   // Update cached data.
   oldPoly->rebuildBuffers();
   newPoly->rebuildBuffers();
+  m_layoutDirty = true;
 
   emit modified(true);
   return true;
@@ -399,8 +484,11 @@ void MeshItem::addPolygon(PolyLineItem* poly)
   }
   newPolygon.rebuildBuffers();
   m_polygons << newPolygon;
+  m_layoutDirty = true;
 
   recomputeBoundaries();
+  m_gripLayer->updateGeometry();
+  m_edgeLayer->updateGeometry();
 }
 
 void MeshItem::gripDestroyed(QObject* grip)
@@ -410,7 +498,234 @@ void MeshItem::gripDestroyed(QObject* grip)
   }
 }
 
-void MeshItem::renderGL()
+void MeshItem::updateStorage()
+{
+  if (m_layoutDirty) {
+    rebuildLayout();
+  } else if (m_storageDirty) {
+    // Only rewrite the polygons that changed. The layout is unchanged,
+    // so each polygon's data goes back in the same place.
+    int numPolygons = m_polygons.length();
+    for (int i = 0; i < numPolygons; i++) {
+      Polygon& poly = m_polygons[i];
+      if (!poly.dirty) {
+        continue;
+      }
+      int n = poly.positions.length();
+      for (int j = 0; j < n; j++) {
+        m_polyVerts[poly.offset + j] = poly.positions[j];
+        m_polyColors[poly.offset + j] = poly.colors[j];
+        m_polyEdges[poly.offset + j] = poly.edgeLength(j);
+      }
+      m_polyInfo[i] = QVector3D(poly.offset, n, poly.windingDirection);
+      m_gradientCache.invalidate(i);
+      poly.dirty = false;
+    }
+  }
+  m_storageDirty = false;
+
+  if (m_capsDirty) {
+    rebuildCaps();
+  }
+}
+
+void MeshItem::rebuildLayout()
+{
+  QVector<QVector2D> verts;
+  QVector<QVector4D> colors;
+  QVector<GLfloat> edges;
+  QVector<QVector3D> polyInfo;
+  QVector<GLfloat> polyBoundary;
+  QVector<QVector2D> fanIndices;
+
+  // Boundary edges join vertices that are adjacent on the boundary.
+  QHash<GripItem*, int> boundaryIndex;
+  int boundaryLength = m_boundary.length();
+  for (int i = 0; i < boundaryLength; i++) {
+    boundaryIndex[m_boundary[i]] = i;
+  }
+
+  int numPolygons = m_polygons.length();
+  for (int i = 0; i < numPolygons; i++) {
+    Polygon& poly = m_polygons[i];
+    if (!poly.windingDirection) {
+      poly.updateWindingDirection();
+    }
+    int n = poly.positions.length();
+    poly.offset = verts.length();
+    poly.fanOffset = fanIndices.length();
+    poly.dirty = false;
+    verts += poly.positions;
+    colors += poly.colors;
+    for (int j = 0; j < n; j++) {
+      edges << poly.edgeLength(j);
+      int a = boundaryIndex.value(poly.vertices[j], -1);
+      int b = boundaryIndex.value(poly.vertices[(j + 1) % n], -1);
+      int step = (b - a + boundaryLength) % qMax(boundaryLength, 1);
+      polyBoundary << (a >= 0 && b >= 0 && (step == 1 || step == boundaryLength - 1) ? 1 : 0);
+    }
+    polyInfo << QVector3D(poly.offset, n, poly.windingDirection);
+
+    // Unroll the triangle fan so that every polygon can go in one draw call.
+    for (int j = 1; j < n - 1; j++) {
+      fanIndices << QVector2D(i, 0) << QVector2D(i, j) << QVector2D(i, j + 1);
+    }
+  }
+
+  m_polyVerts = verts;
+  m_polyColors = colors;
+  m_polyEdges = edges;
+  m_polyInfo = polyInfo;
+  m_polyBoundary = polyBoundary;
+  m_fanIndices = fanIndices;
+  m_gradientCache.clear();
+  m_layoutDirty = false;
+  m_capsDirty = true;
+}
+
+void MeshItem::rebuildCaps()
+{
+  // The rounded part of each smooth corner is evaluated against every polygon
+  // that touches it. The rest of the corner is masked out by the stencil.
+  QVector<BoundaryVertex> verts;
+  int numPolygons = m_polygons.length();
+  for (const BoundaryCorner& corner : m_corners) {
+    QVector2D origin(corner.origin), inverseX(corner.inverseX), inverseY(corner.inverseY);
+    for (int i = 0; i < numPolygons; i++) {
+      if (!m_polygons[i].vertices.contains(corner.vertex)) {
+        continue;
+      }
+      QVector2D polygon(i, -1);
+      verts << BoundaryVertex{ QVector2D(corner.prev), origin, inverseX, inverseY, polygon };
+      verts << BoundaryVertex{ QVector2D(corner.midpoint), origin, inverseX, inverseY, polygon };
+      verts << BoundaryVertex{ QVector2D(corner.lastMidpoint), origin, inverseX, inverseY, polygon };
+    }
+  }
+
+  m_boundaryVerts = verts;
+  m_capsDirty = false;
+}
+
+bool MeshItem::updateGradientCache(GLFunctions* gl, const QTransform& transform)
+{
+  // Exports are only rendered once, so there's nothing to gain from caching.
+  // The cache is also aligned to full-resolution pixels.
+  GLViewport* view = GLViewport::instance(QOpenGLContext::currentContext());
+  if (!view || view->renderScale() < 1) {
+    return false;
+  }
+  if (!m_gradientCache.begin(gl, transform, pos(), m_polygons.length())) {
+    return false;
+  }
+
+  GLint viewport[4];
+  gl->glGetIntegerv(GL_VIEWPORT, viewport);
+  QRectF visible(viewport[0], viewport[1], viewport[2], viewport[3]);
+  double ndcScale = 2.0 / m_gradientCache.atlasSize();
+
+  // Find the visible polygons that aren't cached yet and reserve space for them.
+  struct Pending {
+    QPointF scale, translate;
+    QRect atlasRect;
+  };
+  QVector<Pending> pending;
+  QPolygonF quads;
+  QVector<QVector2D> quadIndices;
+  int numPolygons = m_polygons.length();
+  for (int i = 0; i < numPolygons; i++) {
+    if (m_gradientCache.isValid(i)) {
+      continue;
+    }
+    QRectF rect = m_gradientCache.windowRect(m_polygons[i].boundingRect());
+    if (!rect.intersects(visible)) {
+      continue;
+    }
+    Pending p;
+    if (!m_gradientCache.allocate(i, rect, &p.scale, &p.translate, &p.atlasRect)) {
+      continue;
+    }
+    pending << p;
+
+    // Cover the whole atlas entry, including the padding, by mapping
+    // its corners back to item coordinates.
+    QRectF ndc(p.atlasRect.x() * ndcScale - 1, p.atlasRect.y() * ndcScale - 1, p.atlasRect.width() * ndcScale, p.atlasRect.height() * ndcScale);
+    QPointF corners[4];
+    corners[0] = ndc.topLeft();
+    corners[1] = ndc.topRight();
+    corners[2] = ndc.bottomRight();
+    corners[3] = ndc.bottomLeft();
+    for (QPointF& corner : corners) {
+      corner = QPointF((corner.x() - p.translate.x()) / p.scale.x(), (corner.y() - p.translate.y()) / p.scale.y());
+    }
+    quads << corners[0] << corners[1] << corners[2] << corners[0] << corners[2] << corners[3];
+    for (int k = 0; k < 6; k++) {
+      quadIndices << QVector2D(i, -1);
+    }
+  }
+  if (pending.isEmpty()) {
+    return true;
+  }
+  m_cacheQuads = quads;
+  m_cacheIndices = quadIndices;
+
+  GLint oldFramebuffer, oldScissorBox[4];
+  GLfloat oldClearColor[4];
+  gl->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldFramebuffer);
+  gl->glGetIntegerv(GL_SCISSOR_BOX, oldScissorBox);
+  gl->glGetFloatv(GL_COLOR_CLEAR_VALUE, oldClearColor);
+  GLboolean hadScissor = gl->glIsEnabled(GL_SCISSOR_TEST);
+  GLboolean hadStencil = gl->glIsEnabled(GL_STENCIL_TEST);
+  GLboolean hadBlend = gl->glIsEnabled(GL_BLEND);
+
+  int size = m_gradientCache.atlasSize();
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, m_gradientCache.atlas()->handle());
+  gl->glViewport(0, 0, size, size);
+  gl->glEnable(GL_SCISSOR_TEST);
+  gl->glDisable(GL_STENCIL_TEST);
+  // Store the evaluated colors as-is. Blending happens when they're copied out.
+  gl->glDisable(GL_BLEND);
+  gl->glClearColor(0, 0, 0, 0);
+
+  {
+    BoundProgram program = gl->useShader("polyramp", gl->meshDefines());
+    program.bindTextureBuffer("verts", 0, m_polyVerts);
+    program.bindTextureBuffer("colors", 1, m_polyColors);
+    program.bindTextureBuffer("polygons", 2, m_polyInfo);
+    program.bindTextureBuffer("edgeLengths", 4, m_polyEdges);
+    if (gl->analyticAntialiasing()) {
+      program.bindTextureBuffer("boundaryEdges", 5, m_polyBoundary);
+    }
+    program.bindVertexArray(m_cacheArray);
+    program->setUniformValue("useEllipse", false);
+
+    int numPending = pending.length();
+    for (int k = 0; k < numPending; k++) {
+      const Pending& p = pending[k];
+      gl->glScissor(p.atlasRect.x(), p.atlasRect.y(), p.atlasRect.width(), p.atlasRect.height());
+      gl->glClear(GL_COLOR_BUFFER_BIT);
+      program->setUniformValue("translate", p.translate);
+      program->setUniformValue("scale", p.scale);
+      gl->glDrawArrays(GL_TRIANGLES, k * 6, 6);
+    }
+  }
+
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, oldFramebuffer);
+  gl->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  gl->glScissor(oldScissorBox[0], oldScissorBox[1], oldScissorBox[2], oldScissorBox[3]);
+  gl->glClearColor(oldClearColor[0], oldClearColor[1], oldClearColor[2], oldClearColor[3]);
+  if (!hadScissor) {
+    gl->glDisable(GL_SCISSOR_TEST);
+  }
+  if (hadStencil) {
+    gl->glEnable(GL_STENCIL_TEST);
+  }
+  if (hadBlend) {
+    gl->glEnable(GL_BLEND);
+  }
+  return true;
+}
+
+void MeshItem::renderGL(const QRectF& exposed)
 {
   GLFunctions* gl = GLFunctions::instance(QOpenGLContext::currentContext());
   if (!gl) {
@@ -418,60 +733,166 @@ void MeshItem::renderGL()
     return;
   }
 
+  updateStorage();
+
+  // Only draw the polygons that touch both the exposed area and the
+  // viewport, but keep them in a single draw call. The caps are all inside
+  // these polygons. When zoomed in, most polygons are offscreen.
+  QRectF visible = mapRectFromScene(gl->visibleSceneRect());
+  if (!exposed.isNull()) {
+    visible &= exposed;
+  }
+  if (!visible.intersects(boundingRect())) {
+    return;
+  }
+
+  QVector<GLint> fanFirsts;
+  QVector<GLsizei> fanCounts;
+  QVector<int> fanPolygons;
+  int numPolygons = m_polygons.length();
+  for (int i = 0; i < numPolygons; i++) {
+    const Polygon& poly = m_polygons[i];
+    int count = (poly.positions.length() - 2) * 3;
+    if (count <= 0 || !visible.intersects(poly.boundingRect())) {
+      continue;
+    }
+    fanFirsts << poly.fanOffset;
+    fanCounts << count;
+    fanPolygons << i;
+  }
+  if (fanFirsts.isEmpty()) {
+    return;
+  }
+
+  GPUProfiler* profiler = gl->profiler();
+  GPUSample meshSample(profiler, GPUProfiler::PerMesh, this);
+  // Timing each polygon means drawing them one at a time, and cached
+  // polygons wouldn't be measured at all.
+  bool perPolygon = profiler && profiler->isEnabled(GPUProfiler::PerPolygon);
+
+  QTransform transform = gl->transform();
+  QPointF translate(transform.dx() + x() * transform.m11(), transform.dy() + y() * transform.m22());
+  bool useCache = !perPolygon && updateGradientCache(gl, transform);
+
+  // QPainter turns off clipping for native painting. Everything outside
+  // of the exposed area is left over from the previous frame and has to
+  // be preserved, including anything drawn on top of the mesh.
+  GLboolean hadScissor = gl->glIsEnabled(GL_SCISSOR_TEST);
+  GLint oldScissorBox[4];
+  gl->glGetIntegerv(GL_SCISSOR_BOX, oldScissorBox);
+  if (!exposed.isNull()) {
+    QRect clip = gl->deviceRect(mapRectToScene(exposed));
+    if (hadScissor) {
+      clip &= QRect(oldScissorBox[0], oldScissorBox[1], oldScissorBox[2], oldScissorBox[3]);
+    }
+    if (clip.isEmpty()) {
+      return;
+    }
+    gl->glEnable(GL_SCISSOR_TEST);
+    gl->glScissor(clip.x(), clip.y(), clip.width(), clip.height());
+  }
+
   gl->glEnable(GL_BLEND);
   gl->glDisable(GL_MULTISAMPLE);
   gl->glEnable(GL_DITHER);
-  if (m_boundaryTris.count()) {
+
+  int numBoundaryVerts = m_boundaryVerts.count();
+  if (numBoundaryVerts) {
+    // Build the mask once for the whole mesh. Only the area the mesh
+    // covers needs to be cleared. Corners shared by several polygons are
+    // drawn more than once, which doesn't change the result.
     gl->glEnable(GL_STENCIL_TEST);
+    gl->clearStencil(mapRectToScene(boundingRect()));
     gl->glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-  }
-  for (Polygon& poly : m_polygons) {
-    auto& vbo = poly.vertexBuffer;
-    BoundProgram program = gl->useShader("polyramp", vbo.count());
+    gl->glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    gl->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-    program->setUniformValueArray("verts", vbo.vector().constData(), vbo.vector().size());
-    program->setUniformValueArray("colors", poly.colors.vector().constData(), poly.colors.vector().size());
+    BoundProgram mask = gl->useShader("mask");
+    mask->setUniformValue("translate", translate);
+    mask->setUniformValue("scale", transform.m11(), transform.m22());
+    mask.bindVertexArray(m_boundaryArray);
+    gl->glDrawArrays(GL_TRIANGLES, 0, numBoundaryVerts);
 
-    QTransform transform = gl->transform();
-    program->setUniformValue("translate", transform.dx() + x() * transform.m11(), transform.dy() + y() * transform.m22());
-    program->setUniformValue("scale", transform.m11(), transform.m22());
+    gl->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    gl->glStencilMask(0x00);
+  }
 
-    if (!poly.windingDirection) {
-      poly.updateWindingDirection();
+  {
+    QStringList defines = gl->meshDefines();
+    if (useCache) {
+      defines << "GRADIENT_CACHE";
+    }
+    BoundProgram program = gl->useShader("polyramp", defines);
+    program->setUniformValue("translate", translate);
+    program->setUniformValue("scale", transform.m11(), transform.m22());
+    program.bindTextureBuffer("verts", 0, m_polyVerts);
+    program.bindTextureBuffer("colors", 1, m_polyColors);
+    program.bindTextureBuffer("polygons", 2, m_polyInfo);
+    program.bindTextureBuffer("edgeLengths", 4, m_polyEdges);
+    if (gl->analyticAntialiasing()) {
+      program.bindTextureBuffer("boundaryEdges", 5, m_polyBoundary);
+    }
+    if (useCache) {
+      program.bindTextureBuffer("cacheRecords", 3, m_gradientCache.records());
     }
-    program->setUniformValue("windingDirection", poly.windingDirection);
-
-    gl->glClear(GL_STENCIL_BUFFER_BIT);
 
-    if (m_boundaryTris.count()) {
+    if (numBoundaryVerts) {
+      // The rounded part of each masked corner is drawn separately.
       gl->glStencilFunc(GL_ALWAYS, 1, 0xFF);
-      gl->glStencilMask(0xFF);
-      program.bindAttributeBuffer(0, m_boundaryTris);
-      int controlSize = m_control.elementSize();
-      int controlStride = controlSize * 3;
-      for (int i = 0; i < 3; i++) {
-        program.bindAttributeBuffer(i + 1, m_control, i * controlSize, controlStride);
-      }
+      program.bindVertexArray(m_boundaryArray);
       program->setUniformValue("useEllipse", true);
-      gl->glDrawArrays(GL_TRIANGLES, 0, m_boundaryTris.count());
-
+      gl->glDrawArrays(GL_TRIANGLES, 0, numBoundaryVerts);
       gl->glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-      gl->glStencilMask(0x00);
     }
-    program.bindAttributeBuffer(0, vbo);
+    program.bindVertexArray(m_fanArray);
     program->setUniformValue("useEllipse", false);
-    gl->glDrawArrays(GL_TRIANGLE_FAN, 0, vbo.count());
+    if (perPolygon) {
+      // The caps above are only included in the mesh's total.
+      int numFans = fanFirsts.length();
+      for (int k = 0; k < numFans; k++) {
+        GPUSample polygonSample(profiler, GPUProfiler::PerPolygon, this, fanPolygons[k]);
+        gl->glDrawArrays(GL_TRIANGLES, fanFirsts[k], fanCounts[k]);
+      }
+    } else {
+      gl->glMultiDrawArrays(GL_TRIANGLES, fanFirsts.constData(), fanCounts.constData(), fanFirsts.length());
+    }
   }
+
+  if (useCache) {
+    // Copy the cached polygons out of the atlas. The stencil state from
+    // the previous pass still applies.
+    BoundProgram program = gl->useShader("gradientcache");
+    program->setUniformValue("translate", translate);
+    program->setUniformValue("scale", transform.m11(), transform.m22());
+    program->setUniformValue("pan", m_gradientCache.panOffset());
+    program.bindTextureBuffer("verts", 0, m_polyVerts);
+    program.bindTextureBuffer("polygons", 2, m_polyInfo);
+    program.bindTextureBuffer("cacheRecords", 3, m_gradientCache.records());
+    program.bindTexture("atlas", 4, m_gradientCache.atlas()->texture());
+    program.bindVertexArray(m_fanArray);
+    gl->glMultiDrawArrays(GL_TRIANGLES, fanFirsts.constData(), fanCounts.constData(), fanFirsts.length());
+  }
+
+  gl->glStencilMask(0xFF);
   gl->glDisable(GL_STENCIL_TEST);
   gl->glEnable(GL_MULTISAMPLE);
-
+  gl->glScissor(oldScissorBox[0], oldScissorBox[1], oldScissorBox[2], oldScissorBox[3]);
+  if (!hadScissor) {
+    gl->glDisable(GL_SCISSOR_TEST);
+  }
 }
 
-void MeshItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+void MeshItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget*)
 {
   painter->beginNativePainting();
 
-  renderGL();
+  GLViewport* view = GLViewport::instance(QOpenGLContext::currentContext());
+  if (view && view->beginScaledLayer(mapRectToScene(option->exposedRect))) {
+    renderGL(option->exposedRect);
+    view->endScaledLayer();
+  } else {
+    renderGL(option->exposedRect);
+  }
 
   painter->endNativePainting();
 
@@ -502,46 +923,43 @@ EdgeItem* MeshItem::findOrCreateEdge(GripItem* v1, GripItem* v2)
   }
   EdgeItem* edge = new EdgeItem(v1, v2);
   QObject::connect(edge, SIGNAL(insertVertex(EdgeItem*,QPointF)), this, SLOT(insertVertex(EdgeItem*,QPointF)));
+  QObject::connect(edge, SIGNAL(hoverChanged(EdgeItem*,bool)), this, SLOT(updateEdgeHover(EdgeItem*,bool)));
   m_edges.append(edge);
   return edge;
 }
 
 void MeshItem::updateBoundary()
 {
+  m_corners.clear();
+  m_capsDirty = true;
   if (m_boundary.length() < 3) {
     return;
   }
-  QPolygonF tris(m_boundary.length() * 3);
-  QVector<QPointF> control(m_boundary.length() * 9);
-  QVector<int> smooth(m_boundary.length() * 3);
-  QPointF prev = m_boundary.last()->pos();
+  GripItem* lastGrip = m_boundary.last();
+  QPointF prev = lastGrip->pos();
   QPointF lastMidpoint = (prev + m_boundary[m_boundary.length() - 2]->pos()) / 2;
-  int i = 0;
-  int j = 0;
-  bool lastSmooth = m_boundary.last()->isSmooth();
   for (GripItem* grip : m_boundary) {
     QPointF curr = grip->pos();
     QPointF midpoint = (curr + prev) / 2;
 
-    if (lastSmooth) {
-      for (int k = 0; k < 3; k++) {
-        smooth[i + k] = lastSmooth ? 1 : 0;
-        control[j++] = prev;
-        control[j++] = lastMidpoint;
-        control[j++] = midpoint;
+    if (lastGrip->isSmooth()) {
+      BoundaryCorner corner{ lastGrip, prev, lastMidpoint, midpoint };
+      QPointF a = prev - lastMidpoint;
+      QPointF b = prev - midpoint;
+      double det = a.x() * b.y() - b.x() * a.y();
+      // A straight corner doesn't need to be rounded.
+      if (det) {
+        corner.origin = prev - a - b;
+        corner.inverseX = QPointF(b.y(), -a.y()) / det;
+        corner.inverseY = QPointF(-b.x(), a.x()) / det;
+        m_corners << corner;
       }
-      tris[i++] = prev;
-      tris[i++] = midpoint;
-      tris[i++] = lastMidpoint;
     }
 
     prev = curr;
     lastMidpoint = midpoint;
-    lastSmooth = grip->isSmooth();
+    lastGrip = grip;
   }
-  m_boundaryTris = tris;
-  m_control = control;
-  m_smooth = smooth;
 }
 
 void MeshItem::recomputeBoundaries()
@@ -11,10 +11,37 @@
 #include <QSet>
 #include <QJsonObject>
 #include "glbuffer.h"
+#include "gradientcache.h"
+#include "vertexarray.h"
 #include "markeritem.h"
 class GripItem;
 class EdgeItem;
 class PolyLineItem;
+class GripLayerItem;
+class EdgeLayerItem;
+
+// A vertex of one of the triangles that covers the rounded part of a smooth
+// corner of the boundary. The control points describe the corner's ellipse
+// and polygon indexes the polygon that the triangle is evaluated against.
+struct BoundaryVertex
+{
+  QVector2D pos;
+  QVector2D origin, inverseX, inverseY;
+  QVector2D polygon;
+
+  inline bool operator==(const BoundaryVertex& other) const
+  {
+    return pos == other.pos && origin == other.origin && inverseX == other.inverseX &&
+      inverseY == other.inverseY && polygon == other.polygon;
+  }
+};
+
+VERTEX_FORMAT(BoundaryVertex,
+  VERTEX_ATTRIBUTE(BoundaryVertex, pos, 0),
+  VERTEX_ATTRIBUTE(BoundaryVertex, origin, 1),
+  VERTEX_ATTRIBUTE(BoundaryVertex, inverseX, 2),
+  VERTEX_ATTRIBUTE(BoundaryVertex, inverseY, 3),
+  VERTEX_ATTRIBUTE(BoundaryVertex, polygon, 4))
 
 class MeshItem : public QObject, public QGraphicsPolygonItem
 {
@@ -31,11 +58,18 @@ public:
   bool verticesVisible() const;
   void setVerticesVisible(bool on);
 
+  int polygonCount() const;
+  int polygonSize(int index) const;
+
+  const QVector<GripItem*>& grips() const;
+  const QVector<EdgeItem*>& edges() const;
   GripItem* activeVertex() const;
   bool splitPolygon(GripItem* v1, GripItem* v2);
   bool splitPolygon(GripItem* vertex, EdgeItem* edge);
 
-  void renderGL();
+  // Only the parts of the mesh that intersect exposed (in item
+  // coordinates) are drawn. A null rect draws everything.
+  void renderGL(const QRectF& exposed = QRectF());
 
 public slots:
   void moveVertex(GripItem* vertex, const QPointF& pos);
@@ -43,6 +77,8 @@ public slots:
   void insertVertex(EdgeItem* edge, const QPointF& pos);
   void setActiveVertex(GripItem* vertex);
   void addPolygon(PolyLineItem* poly);
+  void updateGrip(MarkerItem* grip);
+  void updateEdgeHover(EdgeItem* edge, bool hovered);
 
 protected slots:
   void gripDestroyed(QObject* grip);
@@ -56,25 +92,42 @@ protected:
   void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget);
 
 private:
+  // Reads the polygon storage to draw the mesh without OpenGL.
+  friend class CPURenderer;
+
   struct Polygon {
   public:
     Polygon();
     QVector<GripItem*> vertices;
     QVector<EdgeItem*> edges;
-    GLBuffer<QVector2D> vertexBuffer;
-    GLBuffer<QVector4D> colors;
+    QVector<QVector2D> positions;
+    QVector<QVector4D> colors;
     GLfloat windingDirection;
 
+    // Where this polygon's data lives in the mesh's GPU storage, where its
+    // triangles start in the fan index list, and whether it needs to be
+    // written there again.
+    int offset;
+    int fanOffset;
+    bool dirty;
+
+    // Kept up to date as vertices move so that offscreen polygons can
+    // be skipped cheaply.
+    QRectF bounds;
+
     bool insertVertex(GripItem* vertex, EdgeItem* oldEdge, EdgeItem* newEdge);
 
-    inline QPointF vertex(int index) const { return vertexBuffer[index].toPointF(); }
-    inline void setVertex(int index, const QPointF& pos) { vertexBuffer[index] = QVector2D(pos); }
+    inline QPointF vertex(int index) const { return positions[index].toPointF(); }
+    void setVertex(int index, const QPointF& pos);
+    inline GLfloat edgeLength(int index) const { return positions[index].distanceToPoint(positions[(index + 1) % positions.length()]); }
 
     QColor color(int index) const;
     void setColor(int index, const QColor& color);
 
     void updateWindingDirection();
     void rebuildBuffers();
+    void updateBounds();
+    inline QRectF boundingRect() const { return bounds; }
 
     QSet<EdgeItem*> edgesContainingVertex(GripItem* vertex) const;
     bool isEdgeInside(GripItem* v1, GripItem* v2) const;
@@ -85,16 +138,64 @@ private:
     bool testEdge(GripItem* v1, GripItem* v2, EdgeItem* edge1, EdgeItem* edge2) const;
   };
 
+  // The corner of the boundary around a smooth vertex that gets clipped to an ellipse.
+  // A point p is inside the ellipse if |inverse * (p - origin)| <= 1, where the
+  // columns of the inverse basis are stored in inverseX and inverseY.
+  struct BoundaryCorner {
+    GripItem* vertex;
+    QPointF prev, lastMidpoint, midpoint;
+    QPointF origin, inverseX, inverseY;
+  };
+
   QSet<Polygon*> polygonsContainingVertex(GripItem* vertex);
   Polygon* findSplittablePolygon(GripItem* v1, GripItem* v2);
   EdgeItem* findOrCreateEdge(GripItem* v1, GripItem* v2);
   void recomputeBoundaries();
+  QRectF affectedRect(GripItem* vertex) const;
+  void updateStorage();
+  void rebuildLayout();
+  void rebuildCaps();
+  bool updateGradientCache(GLFunctions* gl, const QTransform& transform);
 
   QVector<GripItem*> m_grips, m_boundary;
   QVector<EdgeItem*> m_edges;
   QList<Polygon> m_polygons;
-  GLBuffer<QPointF> m_boundaryTris, m_control;
-  GLBuffer<GLint> m_smooth;
+  QVector<BoundaryCorner> m_corners;
+
+  // All polygons are drawn together from these buffers. m_polyVerts,
+  // m_polyColors and m_polyInfo are persistent storage read by the shaders
+  // as texture buffers. Editing a vertex only rewrites the polygons that
+  // contain it; the layout is only rebuilt when the topology changes.
+  bool m_layoutDirty, m_storageDirty, m_capsDirty;
+  GLBuffer<QVector2D> m_polyVerts;
+  GLBuffer<QVector4D> m_polyColors;
+  GLBuffer<GLfloat> m_polyEdges;
+  GLBuffer<QVector3D> m_polyInfo;
+  // 1 for each polygon edge that lies on the mesh boundary. This only
+  // changes with the layout.
+  GLBuffer<GLfloat> m_polyBoundary;
+
+  // Triangle lists that index into the storage above: x is the index of
+  // the polygon and y is the index of the vertex within the polygon.
+  GLBuffer<QVector2D> m_fanIndices;
+
+  // The triangles over the smooth corners of the boundary, repeated for each
+  // polygon that touches the corner. They build the stencil mask and then
+  // draw the rounded part of each corner. This only changes when the
+  // boundary does.
+  GLBuffer<BoundaryVertex> m_boundaryVerts;
+
+  // Polygons that haven't changed since the last frame are copied from
+  // the cache instead of being evaluated again.
+  GradientCache m_gradientCache;
+  GLBuffer<QPointF> m_cacheQuads;
+  GLBuffer<QVector2D> m_cacheIndices;
+
+  // Attribute layouts for each of the passes above
+  VertexArray m_boundaryArray, m_fanArray, m_cacheArray;
+
+  GripLayerItem* m_gripLayer;
+  EdgeLayerItem* m_edgeLayer;
   QPointer<GripItem> m_lastVertex;
   QGraphicsEllipseItem* m_lastVertexFocus;
   bool m_edgesVisible, m_verticesVisible;
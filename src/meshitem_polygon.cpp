@@ -6,7 +6,7 @@
 #include <algorithm>
 
 MeshItem::Polygon::Polygon()
-: windingDirection(0)
+: windingDirection(0), offset(-1), fanOffset(-1), dirty(true)
 {
   // initializers only
 }
@@ -44,6 +44,7 @@ QColor MeshItem::Polygon::color(int index) const
 void MeshItem::Polygon::setColor(int index, const QColor& color)
 {
   colors[index] = QVector4D(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+  dirty = true;
 }
 
 void MeshItem::Polygon::updateWindingDirection()
@@ -68,17 +69,56 @@ void MeshItem::Polygon::updateWindingDirection()
 void MeshItem::Polygon::rebuildBuffers()
 {
   int numVertices = vertices.length();
-  vertexBuffer.resize(numVertices);
+  positions.resize(numVertices);
   colors.resize(numVertices);
   for (int i = 0; i < numVertices; i++) {
     GripItem* grip = vertices[i];
-    QColor color = grip->color();
-    setVertex(i, grip->pos());
-    setColor(i, color);
+    positions[i] = QVector2D(grip->pos());
+    setColor(i, grip->color());
   }
+  dirty = true;
+  updateBounds();
   updateWindingDirection();
 }
 
+void MeshItem::Polygon::setVertex(int index, const QPointF& pos)
+{
+  QPointF old = vertex(index);
+  positions[index] = QVector2D(pos);
+  dirty = true;
+
+  if (old.x() == bounds.left() || old.x() == bounds.right() || old.y() == bounds.top() || old.y() == bounds.bottom()) {
+    // The vertex may have been holding the bounds open.
+    updateBounds();
+  } else {
+    // Use the stored single-precision value so the test above stays exact.
+    QPointF stored = vertex(index);
+    bounds.setCoords(
+      qMin(bounds.left(), stored.x()),
+      qMin(bounds.top(), stored.y()),
+      qMax(bounds.right(), stored.x()),
+      qMax(bounds.bottom(), stored.y())
+    );
+  }
+}
+
+void MeshItem::Polygon::updateBounds()
+{
+  if (positions.isEmpty()) {
+    bounds = QRectF();
+    return;
+  }
+  float left = positions[0].x(), right = left;
+  float top = positions[0].y(), bottom = top;
+  for (const QVector2D& pos : positions) {
+    left = qMin(left, pos.x());
+    right = qMax(right, pos.x());
+    top = qMin(top, pos.y());
+    bottom = qMax(bottom, pos.y());
+  }
+  bounds.setCoords(left, top, right, bottom);
+}
+
 QSet<EdgeItem*> MeshItem::Polygon::edgesContainingVertex(GripItem* vertex) const
 {
   QSet<EdgeItem*> result;
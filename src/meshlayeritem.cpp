@@ -0,0 +1,29 @@
+#include "meshlayeritem.h"
+#include "meshitem.h"
+#include "dreamproject.h"
+
+MeshLayerItem::MeshLayerItem(MeshItem* mesh, double radius)
+: QGraphicsItem(mesh), mesh(mesh), margin(radius + 1), radius(radius)
+{
+  // initializers only
+}
+
+void MeshLayerItem::setViewScale(double scale)
+{
+  // Leave a pixel to spare for antialiasing.
+  double newMargin = (radius + 1) / scale;
+  if (newMargin != margin) {
+    prepareGeometryChange();
+    margin = newMargin;
+  }
+}
+
+QVariant MeshLayerItem::itemChange(GraphicsItemChange change, const QVariant& value)
+{
+  if (change == ItemSceneHasChanged) {
+    if (DreamProject* project = dynamic_cast<DreamProject*>(scene())) {
+      setViewScale(project->viewScale());
+    }
+  }
+  return QGraphicsItem::itemChange(change, value);
+}
@@ -0,0 +1,30 @@
+#ifndef DL_MESHLAYERITEM_H
+#define DL_MESHLAYERITEM_H
+
+#include <QGraphicsItem>
+class MeshItem;
+
+// MeshLayerItem is the base of the items that draw a mesh's grips and edges
+// in one call. What they draw is a fixed size on screen, so the margin their
+// bounding rects need around it depends on the zoom level. The project sets
+// it whenever the view's scale changes, since it can't change while painting.
+class MeshLayerItem : public QGraphicsItem
+{
+public:
+  // radius is how far the layer draws past its points, in pixels.
+  MeshLayerItem(MeshItem* mesh, double radius);
+
+  void setViewScale(double scale);
+
+protected:
+  QVariant itemChange(GraphicsItemChange change, const QVariant& value);
+
+  MeshItem* mesh;
+  // How far the layer draws past its points, in item coordinates
+  double margin;
+
+private:
+  double radius;
+};
+
+#endif
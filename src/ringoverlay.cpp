@@ -0,0 +1,52 @@
+#include "ringoverlay.h"
+#include <QPainter>
+#include <QEvent>
+
+RingOverlay::RingOverlay(QWidget* parent)
+: QWidget(parent), m_radius(0)
+{
+  setAttribute(Qt::WA_TransparentForMouseEvents, true);
+  setFocusPolicy(Qt::NoFocus);
+  setGeometry(parent->rect());
+  parent->installEventFilter(this);
+}
+
+bool RingOverlay::eventFilter(QObject* obj, QEvent* event)
+{
+  if (obj == parent() && event->type() == QEvent::Resize) {
+    setGeometry(parentWidget()->rect());
+  }
+  return QWidget::eventFilter(obj, event);
+}
+
+QRect RingOverlay::ringRect() const
+{
+  // Leave room for the widest pen and the antialiased edge.
+  double extent = m_radius + 3;
+  return QRectF(m_center.x() - extent, m_center.y() - extent, extent * 2, extent * 2).toAlignedRect();
+}
+
+void RingOverlay::setRing(const QPointF& center, double radius)
+{
+  if (center == m_center && radius == m_radius) {
+    return;
+  }
+  QRect oldRect = ringRect();
+  m_center = center;
+  m_radius = radius;
+  update(QRegion(oldRect) + ringRect());
+}
+
+void RingOverlay::paintEvent(QPaintEvent*)
+{
+  QPainter p(this);
+  p.setRenderHint(QPainter::Antialiasing);
+  p.setPen(QPen(Qt::black, 4));
+  p.drawEllipse(m_center, m_radius, m_radius);
+  p.setPen(QPen(Qt::white, 2));
+  p.drawEllipse(m_center, m_radius, m_radius);
+  p.setPen(QPen(QColor(128, 128, 128), 1.5));
+  p.drawEllipse(m_center + QPointF(0.5, 0.5), m_radius, m_radius);
+  p.setPen(QPen(Qt::white, 1));
+  p.drawEllipse(m_center - QPointF(0.5, 0.5), m_radius, m_radius);
+}
@@ -0,0 +1,28 @@
+#ifndef DL_RINGOVERLAY_H
+#define DL_RINGOVERLAY_H
+
+#include <QWidget>
+
+// RingOverlay draws the cursor ring on top of the GL viewport. Because it is
+// a separate widget, moving the ring only recomposites the window and never
+// causes the scene underneath to be rendered again.
+class RingOverlay : public QWidget
+{
+Q_OBJECT
+public:
+  RingOverlay(QWidget* parent);
+
+  void setRing(const QPointF& center, double radius);
+
+protected:
+  bool eventFilter(QObject* obj, QEvent* event);
+  void paintEvent(QPaintEvent*);
+
+private:
+  QRect ringRect() const;
+
+  QPointF m_center;
+  double m_radius;
+};
+
+#endif
@@ -77,6 +77,11 @@ Qt::CursorShape Tool::cursorShape() const
   return Qt::BitmapCursor;
 }
 
+bool Tool::needsEveryMotion() const
+{
+  return false;
+}
+
 void Tool::activated(EditorView*)
 {
   // no-op
@@ -24,6 +24,9 @@ public:
   static Tool* get(Tool::Type type);
 
   virtual Qt::CursorShape cursorShape() const;
+  // EditorView only delivers the latest mouse position once per frame
+  // unless the tool needs to see every intermediate position.
+  virtual bool needsEveryMotion() const;
 
   virtual void activated(EditorView* editor);
   virtual void deactivated(EditorView* editor);
@@ -37,3 +37,8 @@ bool ColorTool::mouseReleaseEvent(EditorView* editor, QMouseEvent* event)
   isDragging = false;
   return true;
 }
+
+bool ColorTool::needsEveryMotion() const
+{
+  return isDragging;
+}
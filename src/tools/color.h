@@ -13,6 +13,9 @@ public:
   virtual bool mouseMoveEvent(EditorView* editor, QMouseEvent* event);
   virtual bool mouseReleaseEvent(EditorView* editor, QMouseEvent* event);
 
+  // Painting colors onto vertices has to follow the whole stroke.
+  virtual bool needsEveryMotion() const;
+
 private:
   bool isDragging = false;
 };
@@ -0,0 +1,140 @@
+#include "vertexarray.h"
+#include "glfunctions.h"
+#include "glbuffer.h"
+#include <QOpenGLContext>
+#include <QOpenGLVertexArrayObject>
+#include <QtDebug>
+
+VertexArray::VertexArray()
+: m_bound(nullptr)
+{
+  // initializers only
+}
+
+VertexArray::~VertexArray()
+{
+  while (!m_arrays.isEmpty()) {
+    removeContext(m_arrays.begin().key());
+  }
+}
+
+void VertexArray::removeContext(QOpenGLContext* ctx)
+{
+  ContextArray* array = m_arrays.take(ctx);
+  if (!array) {
+    return;
+  }
+  QObject::disconnect(array->destroyed);
+  if (m_bound == array->vao) {
+    m_bound = nullptr;
+  }
+  delete array->vao;
+  delete array;
+}
+
+void VertexArray::setAttributeBuffer(int location, GLBufferBase* buffer, int offset, int stride, int divisor)
+{
+  if (stride < 0) {
+    stride = buffer->elementSize();
+  }
+  setAttribute(location, buffer, buffer->glType(), buffer->elementLength(), offset, stride, divisor);
+}
+
+void VertexArray::setAttribute(int location, GLBufferBase* buffer, int type, int length, int offset, int stride, int divisor)
+{
+  Attribute newAttr{ location, buffer, type, length, offset, stride, divisor };
+  for (int i = 0; i < m_attributes.length(); i++) {
+    Attribute& attr = m_attributes[i];
+    if (attr.location == location) {
+      if (attr.buffer != buffer || attr.type != type || attr.length != length || attr.offset != offset || attr.stride != stride || attr.divisor != divisor) {
+        attr = newAttr;
+        forget(i);
+      }
+      return;
+    }
+  }
+  m_attributes << newAttr;
+}
+
+// Makes every context's VAO specify the attribute again.
+void VertexArray::forget(int index)
+{
+  for (ContextArray* array : m_arrays) {
+    if (index < array->bufferIds.length()) {
+      array->bufferIds[index] = 0;
+      array->generations[index] = -1;
+    }
+  }
+}
+
+void VertexArray::clear()
+{
+  m_attributes.clear();
+  // Forget which attributes were enabled.
+  while (!m_arrays.isEmpty()) {
+    removeContext(m_arrays.begin().key());
+  }
+}
+
+bool VertexArray::bind(GLFunctions* gl)
+{
+  QOpenGLContext* ctx = QOpenGLContext::currentContext();
+  ContextArray* array = m_arrays.value(ctx);
+  if (!array) {
+    QOpenGLVertexArrayObject* vao = new QOpenGLVertexArrayObject();
+    if (!vao->create()) {
+      qDebug() << "unable to create vertex array object";
+      delete vao;
+      return false;
+    }
+    array = new ContextArray{ vao, QVector<GLuint>(), QVector<int>(), QMetaObject::Connection() };
+    array->destroyed = QObject::connect(ctx, &QOpenGLContext::aboutToBeDestroyed, [this, ctx]{ removeContext(ctx); });
+    m_arrays[ctx] = array;
+  }
+  // Attributes added since the VAO was last used haven't been specified.
+  int numAttributes = m_attributes.length();
+  while (array->bufferIds.length() < numAttributes) {
+    array->bufferIds << 0;
+    array->generations << -1;
+  }
+
+  // Binding a buffer uploads any pending changes, which may replace its
+  // storage or, for pooled buffers, move other buffers in the same arena.
+  // Do all of that before recording any pointers.
+  QVector<bool> ready(numAttributes);
+  for (int i = 0; i < numAttributes; i++) {
+    GLBufferBase* buffer = m_attributes[i].buffer;
+    ready[i] = buffer->bind();
+    if (!ready[i]) {
+      qDebug() << "bind failure";
+    }
+    buffer->release();
+  }
+
+  array->vao->bind();
+  m_bound = array->vao;
+  for (int i = 0; i < numAttributes; i++) {
+    Attribute& attr = m_attributes[i];
+    if (!ready[i]) {
+      continue;
+    }
+    attr.buffer->bind();
+    if (array->bufferIds[i] != attr.buffer->bufferId() || array->generations[i] != attr.buffer->storageGeneration()) {
+      gl->glEnableVertexAttribArray(attr.location);
+      gl->glVertexAttribPointer(attr.location, attr.length, attr.type, GL_FALSE, attr.stride, reinterpret_cast<const void*>(qintptr(attr.buffer->storageOffset() + attr.offset)));
+      gl->glVertexAttribDivisor(attr.location, attr.divisor);
+      array->bufferIds[i] = attr.buffer->bufferId();
+      array->generations[i] = attr.buffer->storageGeneration();
+    }
+    attr.buffer->release();
+  }
+  return true;
+}
+
+void VertexArray::release()
+{
+  if (m_bound) {
+    m_bound->release();
+    m_bound = nullptr;
+  }
+}
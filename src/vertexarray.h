@@ -0,0 +1,73 @@
+#ifndef DL_VERTEXARRAY_H
+#define DL_VERTEXARRAY_H
+
+#include <QVector>
+#include <QHash>
+#include <QMetaObject>
+#include <qopengl.h>
+#include "glbuffer.h"
+class QOpenGLContext;
+class QOpenGLVertexArrayObject;
+class GLFunctions;
+
+// VertexArray owns a vertex array object with a fixed set of attribute
+// bindings. The bindings are recorded into the VAO the first time it's used
+// and only specified again if a buffer's storage is replaced, so drawing
+// from it just binds the VAO.
+//
+// VAOs can't be shared between contexts, so there is one for each context
+// the VertexArray is used in. It's kept until the context is destroyed, so
+// that the viewport and the export context can take turns drawing an item.
+class VertexArray
+{
+public:
+  VertexArray();
+  VertexArray(const VertexArray& other) = delete;
+  ~VertexArray();
+
+  // A nonzero divisor advances the attribute once per that many instances.
+  void setAttributeBuffer(int location, GLBufferBase* buffer, int offset = 0, int stride = -1, int divisor = 0);
+  // Feeds every attribute of an interleaved vertex format from one buffer.
+  template <typename T>
+  void setVertexBuffer(GLBuffer<T>* buffer, int divisor = 0)
+  {
+    for (const GLBufferContainer::Attribute& attr : GLBufferContainer::Format<T>::attributes) {
+      setAttribute(attr.location, buffer, attr.type, attr.length, attr.offset, buffer->elementSize(), divisor);
+    }
+  }
+  void clear();
+
+  // Uploads any changes to the buffers and binds the VAO.
+  bool bind(GLFunctions* gl);
+  void release();
+
+private:
+  void setAttribute(int location, GLBufferBase* buffer, int type, int length, int offset, int stride, int divisor);
+
+  struct Attribute {
+    int location;
+    GLBufferBase* buffer;
+    int type;
+    int length;
+    int offset;
+    int stride;
+    int divisor;
+  };
+
+  struct ContextArray {
+    QOpenGLVertexArrayObject* vao;
+    // The buffer storage that the VAO currently points to, per attribute
+    QVector<GLuint> bufferIds;
+    QVector<int> generations;
+    QMetaObject::Connection destroyed;
+  };
+
+  void forget(int index);
+  void removeContext(QOpenGLContext* ctx);
+
+  QVector<Attribute> m_attributes;
+  QHash<QOpenGLContext*, ContextArray*> m_arrays;
+  QOpenGLVertexArrayObject* m_bound;
+};
+
+#endif